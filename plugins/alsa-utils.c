@@ -46,7 +46,7 @@ static void restore(void *arg)
 
 static plugin_t plugin = {
 	.name = __FILE__,
-	.hook[HOOK_BASEFS_UP] = { .cb  = restore },
+	.hook[HOOK_BASEFS_UP] = { .cb  = restore, .async = 1 },
 	.hook[HOOK_SHUTDOWN]  = { .cb  = save    }
 };
 
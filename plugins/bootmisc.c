@@ -21,9 +21,16 @@
  * THE SOFTWARE.
  */
 
-#include <ftw.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
 #include <mntent.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <lite/lite.h>
 
 #include "config.h"
@@ -64,18 +71,257 @@ static int is_tmpfs(char *path)
 	return tmpfs;
 }
 
-static int do_clean(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftw)
+/* From getdents64(2), not all C libraries have a wrapper */
+struct linux_dirent64 {
+	uint64_t       d_ino;
+	int64_t        d_off;
+	unsigned short d_reclen;
+	unsigned char  d_type;
+	char           d_name[];
+};
+
+static int rm_pass(int dfd, dev_t dev, char *buf, size_t len);
+
+/*
+ * Remove everything in directory @dfd, without following symlinks or
+ * crossing into other file systems than @dev.  All operations are
+ * relative to the directory descriptor, so no path lookups.
+ */
+static void rm_tree(int dfd, dev_t dev)
+{
+	const size_t len = 32768;
+	char *buf;
+
+	buf = malloc(len);
+	if (!buf)
+		return;
+
+	/* Removing entries while reading may skip some, so go again */
+	while (rm_pass(dfd, dev, buf, len) > 0)
+		lseek(dfd, 0, SEEK_SET);
+
+	free(buf);
+}
+
+static int rm_pass(int dfd, dev_t dev, char *buf, size_t len)
+{
+	int removed = 0;
+	ssize_t num;
+
+	while ((num = syscall(SYS_getdents64, dfd, buf, len)) > 0) {
+		ssize_t off;
+
+		for (off = 0; off < num; off += ((struct linux_dirent64 *)&buf[off])->d_reclen) {
+			struct linux_dirent64 *d = (struct linux_dirent64 *)&buf[off];
+			unsigned char type = d->d_type;
+			struct stat st;
+			int fd;
+
+			if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+				continue;
+
+			if (type == DT_UNKNOWN) {
+				if (fstatat(dfd, d->d_name, &st, AT_SYMLINK_NOFOLLOW))
+					continue;
+				type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+			}
+
+			if (type != DT_DIR) {
+				if (!unlinkat(dfd, d->d_name, 0))
+					removed++;
+				continue;
+			}
+
+			fd = openat(dfd, d->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+			if (fd < 0)
+				continue;
+
+			if (!fstat(fd, &st) && st.st_dev == dev)
+				rm_tree(fd, dev);
+			close(fd);
+
+			if (!unlinkat(dfd, d->d_name, AT_REMOVEDIR))
+				removed++;
+		}
+	}
+
+	return removed;
+}
+
+/* Remove everything in @path, and with @self also @path itself */
+static void rm_dir(const char *path, int self)
+{
+	struct stat st;
+	int fd;
+
+	_d("Removing %s%s ...", self ? "" : "all in ", path);
+	fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	if (!fstat(fd, &st))
+		rm_tree(fd, st.st_dev);
+	close(fd);
+
+	if (self)
+		rmdir(path);
+}
+
+#ifdef ASYNC_BOOTCLEAN
+/* One pass over @dfd, moving all entries but @base to @afd */
+static int aside_pass(int dfd, int afd, const char *base, const char *dir)
+{
+	char buf[4096];
+	int moved = 0;
+	ssize_t num;
+
+	while ((num = syscall(SYS_getdents64, dfd, buf, sizeof(buf))) > 0) {
+		ssize_t off;
+
+		for (off = 0; off < num; off += ((struct linux_dirent64 *)&buf[off])->d_reclen) {
+			struct linux_dirent64 *d = (struct linux_dirent64 *)&buf[off];
+
+			if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, "..") || !strcmp(d->d_name, base))
+				continue;
+
+			if (renameat(dfd, d->d_name, afd, d->d_name))
+				_d("Failed moving %s/%s aside: %s", dir, d->d_name, strerror(errno));
+			else
+				moved++;
+		}
+	}
+
+	return moved;
+}
+
+/*
+ * Move everything in @dir to a new directory inside @dir, used when
+ * @dir cannot be renamed, e.g., when it is a mount point.
+ */
+static char *aside_entries(const char *dir)
 {
-	if (ftw->level == 0)
-		return 1;
+	char *path, *base;
+	int dfd, afd;
 
-	_d("Removing %s ...", fpath);
-	(void)remove(fpath);
+	if (asprintf(&path, "%s/.bootclean-XXXXXX", dir) == -1)
+		return NULL;
+	if (!mkdtemp(path)) {
+		free(path);
+		return NULL;
+	}
+	base = strrchr(path, '/') + 1;
+
+	dfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	afd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dfd < 0 || afd < 0)
+		goto fail;
+
+	/* Renaming while reading may skip entries, repeat until done */
+	while (aside_pass(dfd, afd, base, dir) > 0)
+		lseek(dfd, 0, SEEK_SET);
+	close(afd);
+	close(dfd);
 
-	return 0;
+	return path;
+fail:
+	if (afd >= 0)
+		close(afd);
+	if (dfd >= 0)
+		close(dfd);
+	rmdir(path);
+	free(path);
+
+	return NULL;
 }
 
-/* We can safely skip tmpfs, nothing to clean from previous boot there */
+/*
+ * Rename @dir aside and create a new, empty, @dir in its place, with
+ * the same owner and mode.  The old contents can then be removed in
+ * the background without racing anyone creating new files in @dir.
+ *
+ * Returns path to directory to remove, or %NULL.
+ */
+static char *aside(const char *dir)
+{
+	char *real, *path = NULL, *base;
+	struct stat st;
+
+	real = realpath(dir, NULL);
+	if (!real)
+		return NULL;
+
+	/* Parent of, e.g., /tmp is /, but never move / itself */
+	base = strrchr(real, '/');
+	if (stat(real, &st) || !base || !base[1])
+		goto done;
+
+	if (asprintf(&path, "%.*s/.%s.bootclean-XXXXXX", (int)(base - real), real, base + 1) == -1) {
+		path = NULL;
+		goto done;
+	}
+
+	/* rename() replaces the empty placeholder directory */
+	if (!mkdtemp(path)) {
+		free(path);
+		path = aside_entries(real);
+		goto done;
+	}
+	if (rename(real, path)) {
+		if (errno == EBUSY)
+			_d("%s is a mount point, moving its contents aside", real);
+		rmdir(path);
+		free(path);
+		path = aside_entries(real);
+		goto done;
+	}
+
+	if (mkdir(real, 0700) || chown(real, st.st_uid, st.st_gid) || chmod(real, st.st_mode & 07777)) {
+		_pe("Failed recreating %s, restoring it", real);
+		rmdir(real);
+		rename(path, real);
+		free(path);
+		path = NULL;
+	}
+done:
+	free(real);
+
+	return path;
+}
+
+/* Leftovers from a previous boot, where the background removal was cut short */
+static void rm_leftovers(const char *dir)
+{
+	char *real, *base, *pattern;
+	glob_t gl;
+	size_t i;
+
+	real = realpath(dir, NULL);
+	if (!real)
+		return;
+
+	base = strrchr(real, '/');
+	if (!base || !base[1])
+		goto done;
+
+	if (asprintf(&pattern, "%.*s/.%s.bootclean-*", (int)(base - real), real, base + 1) == -1)
+		goto done;
+
+	if (!glob(pattern, GLOB_NOSORT | GLOB_PERIOD, NULL, &gl)) {
+		for (i = 0; i < gl.gl_pathc; i++)
+			rm_dir(gl.gl_pathv[i], 1);
+		globfree(&gl);
+	}
+	free(pattern);
+done:
+	free(real);
+}
+#endif /* ASYNC_BOOTCLEAN */
+
+/*
+ * We can safely skip tmpfs, nothing to clean from previous boot there.
+ * With ASYNC_BOOTCLEAN, each directory is renamed aside and removed
+ * by a background process, not holding up the rest of the bootstrap.
+ */
 static void bootclean(void)
 {
 	char *dir[] = {
@@ -84,13 +330,51 @@ static void bootclean(void)
 		"/var/lock/",
 		NULL
 	};
+#ifdef ASYNC_BOOTCLEAN
+	char *rm[NELEMS(dir)] = { NULL };
+	int i, num = 0;
+	pid_t pid;
+
+	for (i = 0; dir[i]; i++) {
+		if (is_tmpfs(dir[i]))
+			continue;
+
+		rm[num] = aside(dir[i]);
+		if (rm[num])
+			num++;
+		else
+			rm_dir(dir[i], 0);
+	}
+
+	pid = fork();
+	if (!pid) {
+		setsid();
+		if (nice(19) == -1)
+			_d("Failed lowering priority of bootclean: %s", strerror(errno));
 
+		for (i = 0; i < num; i++)
+			rm_dir(rm[i], 1);
+		for (i = 0; dir[i]; i++) {
+			if (!is_tmpfs(dir[i]))
+				rm_leftovers(dir[i]);
+		}
+		_exit(0);
+	}
+	if (pid < 0) {
+		for (i = 0; i < num; i++)
+			rm_dir(rm[i], 1);
+	}
+
+	for (i = 0; i < num; i++)
+		free(rm[i]);
+#else
 	for (int i = 0; dir[i]; i++) {
 		if (is_tmpfs(dir[i]))
 			continue;
 
-		nftw(dir[i], do_clean, 20, FTW_DEPTH);
+		rm_dir(dir[i], 0);
 	}
+#endif
 }
 
 /*
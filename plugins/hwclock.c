@@ -44,7 +44,8 @@ static void restore(void *arg)
 static plugin_t plugin = {
 	.name = __FILE__,
 	.hook[HOOK_BASEFS_UP] = {
-		.cb  = restore
+		.cb    = restore,
+		.async = 1
 	},
 	.hook[HOOK_SHUTDOWN] = {
 		.cb  = save
@@ -162,26 +162,36 @@ static void nl_link(struct nlmsghdr *nlmsg)
 	}
 }
 
+/* Edge triggered, so read until the socket is drained */
 static void nl_callback(void *arg, int sd, int events)
 {
 	ssize_t len;
 	static char buf[4096];
 	struct nlmsghdr *nh;
 
-	memset(buf, 0, sizeof(buf));
-	len = recv(sd, buf, sizeof(buf), 0);
-	if (len < 0) {
-		if (errno != EINTR)	/* Signal */
-			_pe("recv()");
-		return;
-	}
+	while (1) {
+		memset(buf, 0, sizeof(buf));
+		len = recv(sd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR)	/* Signal */
+				continue;
+			if (errno == ENOBUFS) {	/* Overrun, events lost */
+				_e("Netlink overrun, lost events, reasserting net/ conditions");
+				cond_reassert("net/");
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				_pe("recv()");
+			return;
+		}
 
-	for (nh = (struct nlmsghdr *)buf; !nlmsg_validate(nh, len); nh = NLMSG_NEXT(nh, len)) {
-		//_d("Well formed netlink message received. type %d ...", nh->nlmsg_type);
-		if (nh->nlmsg_type == RTM_NEWROUTE || nh->nlmsg_type == RTM_DELROUTE)
-			nl_route(nh);
-		else
-			nl_link(nh);
+		for (nh = (struct nlmsghdr *)buf; !nlmsg_validate(nh, len); nh = NLMSG_NEXT(nh, len)) {
+			//_d("Well formed netlink message received. type %d ...", nh->nlmsg_type);
+			if (nh->nlmsg_type == RTM_NEWROUTE || nh->nlmsg_type == RTM_DELROUTE)
+				nl_route(nh);
+			else
+				nl_link(nh);
+		}
 	}
 }
 
@@ -195,7 +205,7 @@ static plugin_t plugin = {
 	.hook[HOOK_SVC_RECONF] = { .cb = nl_reconf },
 	.io = {
 		.cb    = nl_callback,
-		.flags = PLUGIN_IO_READ,
+		.flags = PLUGIN_IO_READ | PLUGIN_IO_EDGE,
 	},
 };
 
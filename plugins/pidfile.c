@@ -72,6 +72,7 @@ static void pidfile_callback(void *arg, int fd, int events)
 		mkcond(cond, sizeof(cond), svc->cmd);
 		if (ev->mask & (IN_CREATE | IN_ATTRIB | IN_MODIFY)) {
 			svc_started(svc);
+			service_heartbeat(svc);
 			cond_set(cond);
 		} else if (ev->mask & IN_DELETE)
 			cond_clear(cond);
@@ -149,8 +150,9 @@ static plugin_t plugin = {
 	.hook[HOOK_BASEFS_UP]  = { .arg = &pidfile_ctx, .cb = pidfile_init },
 	.hook[HOOK_SVC_RECONF] = { .cb = pidfile_reconf },
 	.io = {
-		.cb    = pidfile_callback,
-		.flags = PLUGIN_IO_READ,
+		.cb      = pidfile_callback,
+		.flags   = PLUGIN_IO_READ,
+		.persist = 1,
 	},
 	.depends = { "bootmisc", "netlink" },
 };
@@ -34,12 +34,14 @@
 
 #include "config.h"
 #include "finit.h"
+#include "cgroup.h"
 #include "cond.h"
 #include "conf.h"
 #include "helpers.h"
 #include "log.h"
 #include "plugin.h"
 #include "private.h"
+#include "prof.h"
 #include "sig.h"
 #include "service.h"
 #include "util.h"
@@ -137,6 +139,40 @@ static svc_t *do_find(char *buf, size_t len)
 	return svc_find_by_nameid(input, id);
 }
 
+/* Reply with the cgroup_stat_t of a service, in place of the query */
+static int do_cgroup(char *buf, size_t len)
+{
+	cgroup_stat_t st;
+	svc_t *svc;
+
+	svc = do_find(buf, len);
+	if (!svc || cgroup_stat(svc, &st) || sizeof(st) > len)
+		return 1;
+
+	memcpy(buf, &st, sizeof(st));
+
+	return 0;
+}
+
+/* Reply with a snapshot of the svc_stats_t of a service, incl. current run */
+static int do_stats(char *buf, size_t len)
+{
+	svc_stats_t st;
+	svc_t *svc;
+
+	svc = do_find(buf, len);
+	if (!svc || sizeof(st) > len)
+		return 1;
+
+	st = svc->stats;
+	if (svc->pid && svc->start_time)
+		st.uptime += jiffies() - svc->start_time;
+
+	memcpy(buf, &st, sizeof(st));
+
+	return 0;
+}
+
 #ifdef INETD_ENABLED
 static int do_query_inetd(char *buf, size_t len)
 {
@@ -203,17 +239,24 @@ static int do_handle_emit(char *buf, size_t len)
 
 static void send_svc(int sd, svc_t *svc)
 {
-	svc_t empty;
+	svc_t empty = { .pid = -1 };
 	size_t len;
 
-	if (!svc) {
-		empty.pid = -1;
+	if (!svc)
 		svc = &empty;
-	}
 
 	len = write(sd, svc, sizeof(*svc));
-	if (len != sizeof(*svc))
+	if (len != sizeof(*svc)) {
 		_d("Failed sending svc_t to client");
+		return;
+	}
+
+	/* Followed by the configuration, see client_svc_recv() */
+	if (svc->conf) {
+		len = write(sd, svc->conf, svc->conf->len);
+		if (len != svc->conf->len)
+			_d("Failed sending svc_conf_t to client");
+	}
 }
 
 
@@ -228,6 +271,7 @@ static void api_cb(uev_t *w, void *arg, int events)
 	svc_t *svc;
 	static svc_t *iter = NULL;
 	struct init_request rq;
+	uint64_t t0 = prof_now();
 
 	sd = accept(w->fd, NULL, NULL);
 	if (sd < 0) {
@@ -367,6 +411,21 @@ static void api_cb(uev_t *w, void *arg, int events)
 			send_svc(sd, do_find(rq.data, sizeof(rq.data)));
 			goto leave;
 
+		case INIT_CMD_SVC_CGROUP:
+			_d("svc cgroup: %s", rq.data);
+			result = do_cgroup(rq.data, sizeof(rq.data));
+			break;
+
+		case INIT_CMD_SVC_STATS:
+			_d("svc stats: %s", rq.data);
+			result = do_stats(rq.data, sizeof(rq.data));
+			break;
+
+		case INIT_CMD_DEBUG_STATS:
+			_d("debug stats, reset: %d", rq.runlevel);
+			prof_send(sd, rq.runlevel);
+			goto leave;
+
 		default:
 			_d("Unsupported cmd: %d", rq.cmd);
 			break;
@@ -383,6 +442,7 @@ static void api_cb(uev_t *w, void *arg, int events)
 
 leave:
 	close(sd);
+	prof_add("api", NULL, t0);
 	if (UEV_ERROR == events)
 		goto error;
 	return;
@@ -0,0 +1,454 @@
+/* Benchmark of the service state machine and condition engine
+ *
+ * Copyright (c) 2026  agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Links the state machine, svc, service and condition code of Finit,
+ * without finit.c, with fork(), kill(), and conf_reload() replaced by
+ * stubs using ld --wrap, see Makefile.am.  No process is ever started,
+ * every service gets a fake PID, and all signals to them are queued as
+ * exits which are delivered by calling service_monitor(), like the
+ * SIGCHLD handler does.
+ *
+ * Conditions are files in /run, so the benchmark runs in a new mount
+ * namespace with a tmpfs on /run.  As non-root, a user namespace is
+ * also needed.
+ *
+ * Build with 'make -C src bench', not built or installed by default.
+ */
+
+#include "config.h"
+
+#include <err.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <sched.h>		/* unshare() */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <lite/lite.h>
+#include <uev/uev.h>
+
+#include "finit.h"
+#include "cond.h"
+#include "conf.h"
+#include "private.h"
+#include "prof.h"
+#include "service.h"
+#include "sm.h"
+#include "svc.h"
+#include "util.h"
+
+/* From finit.c */
+int   wdogpid   = 0;
+int   runlevel  = 2;
+int   cfglevel  = RUNLEVEL;
+int   prevlevel = -1;
+int   rescue    = 0;
+int   single    = 0;
+int   splash    = 0;
+char *sdown     = NULL;
+char *network   = NULL;
+char *hostname  = NULL;
+char *rcsd      = FINIT_RCSD;
+char *runparts  = NULL;
+int   runparts_jobs = 1;
+
+uev_ctx_t *ctx  = NULL;
+
+typedef struct {
+	const char *name;
+	size_t      num, len;
+	uint32_t   *usec;
+	uint64_t    total;
+} op_t;
+
+enum {
+	OP_REGISTER = 0,
+	OP_STEP_ALL,
+	OP_COND_SET,
+	OP_COND_CLEAR,
+	OP_SIGCHLD,
+	OP_RELOAD,
+	OP_CRASH,
+	OP_UNREGISTER,
+	OP_MAX
+};
+
+static op_t ops[OP_MAX] = {
+	[OP_REGISTER]   = { .name = "service_register" },
+	[OP_STEP_ALL]   = { .name = "sm_step (all)"    },
+	[OP_COND_SET]   = { .name = "cond_set"         },
+	[OP_COND_CLEAR] = { .name = "cond_clear"       },
+	[OP_SIGCHLD]    = { .name = "service_monitor"  },
+	[OP_RELOAD]     = { .name = "reload (all)"     },
+	[OP_CRASH]      = { .name = "crash (SIGSEGV)"  },
+	[OP_UNREGISTER] = { .name = "service_unregister" },
+};
+
+static int    nsvc   = 200;	/* Number of services */
+static int    ncond  = 50;	/* Number of conditions */
+static int    nper   = 3;	/* Conditions per service */
+static int    rounds = 1000;	/* Condition flaps */
+static int    reloads = 10;
+static int    generation;
+
+static pid_t  next_pid = 1000;
+static pid_t *exits;
+static size_t nexits, exits_len;
+
+static void op_add(op_t *op, uint64_t start)
+{
+	uint64_t usec = prof_now() - start;
+
+	if (op->num == op->len) {
+		uint32_t *ptr;
+
+		op->len = op->len ? op->len * 2 : 1024;
+		ptr = realloc(op->usec, op->len * sizeof(*ptr));
+		if (!ptr)
+			err(1, "Out of memory");
+		op->usec = ptr;
+	}
+
+	op->usec[op->num++] = usec > UINT32_MAX ? UINT32_MAX : usec;
+	op->total += usec;
+}
+
+static int cmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(void)
+{
+	int i;
+
+	printf("%-20s %8s %10s %8s %8s %8s %8s\n", "OPERATION", "OPS", "OPS/s",
+	       "AVG us", "P50 us", "P99 us", "MAX us");
+	for (i = 0; i < OP_MAX; i++) {
+		op_t *op = &ops[i];
+
+		if (!op->num)
+			continue;
+
+		qsort(op->usec, op->num, sizeof(op->usec[0]), cmp);
+		printf("%-20s %8zu %10.0f %8" PRIu64 " %8u %8u %8u\n", op->name, op->num,
+		       op->total ? op->num * 1e6 / op->total : 0.0, op->total / op->num,
+		       op->usec[op->num / 2], op->usec[op->num * 99 / 100], op->usec[op->num - 1]);
+	}
+}
+
+/*
+ * Stubs, see bench_LDFLAGS
+ */
+pid_t __wrap_pidfd_fork(uev_t *w, uev_cb_t *cb, void *arg)
+{
+	w->fd = -1;
+	return next_pid++;
+}
+
+pid_t __wrap_fork(void)
+{
+	return next_pid++;
+}
+
+/* The process tree of a service is only its main PID */
+int __wrap_kill(pid_t pid, int signo)
+{
+	size_t i;
+
+	if (pid < 0)
+		pid = -pid;
+
+	if (!svc_find_by_pid(pid)) {
+		errno = ESRCH;
+		return -1;
+	}
+
+	if (signo != SIGTERM && signo != SIGKILL)
+		return 0;
+
+	for (i = 0; i < nexits; i++) {
+		if (exits[i] == pid)
+			return 0;
+	}
+
+	if (nexits == exits_len) {
+		pid_t *ptr;
+
+		exits_len = exits_len ? exits_len * 2 : 256;
+		ptr = realloc(exits, exits_len * sizeof(*ptr));
+		if (!ptr)
+			err(1, "Out of memory");
+		exits = ptr;
+	}
+	exits[nexits++] = pid;
+
+	return 0;
+}
+
+/*
+ * Every service line is changed on each reload, every other service
+ * does not support SIGHUP, so half are restarted and half SIGHUP'ed.
+ */
+static void register_all(op_t *op)
+{
+	char line[256], conds[MAX_COND_LEN];
+	int i, j;
+
+	for (i = 0; i < nsvc; i++) {
+		uint64_t start;
+
+		conds[0] = 0;
+		for (j = 0; j < nper; j++) {
+			char cond[16];
+
+			snprintf(cond, sizeof(cond), "%susr/b%d", j ? "," : "", (i + j * 7) % ncond);
+			strlcat(conds, cond, sizeof(conds));
+		}
+
+		snprintf(line, sizeof(line), ":%d [2] <%s%s> /bin/true -g %d", i + 1,
+			 i % 2 ? "!" : "", conds, generation);
+
+		start = prof_now();
+		if (service_register(SVC_TYPE_SERVICE, line, global_rlimit, NULL))
+			errx(1, "Failed registering service %d: %s", i + 1, line);
+		if (op)
+			op_add(op, start);
+	}
+}
+
+/* Reload of all .conf files, every service has been changed */
+int __wrap_conf_reload(void)
+{
+	svc_mark_dynamic();
+	generation++;
+	register_all(NULL);
+
+	return 0;
+}
+
+/* Deliver all queued exits, like the SIGCHLD handler */
+static void reap(op_t *op)
+{
+	while (nexits > 0) {
+		pid_t pid = exits[--nexits];
+		uint64_t start;
+
+		start = prof_now();
+		service_monitor(pid, SIGTERM);
+		if (op)
+			op_add(op, start);
+	}
+}
+
+static void cond_name(char *buf, size_t len, int i)
+{
+	snprintf(buf, len, "usr/b%d", i);
+}
+
+static int writefile(const char *file, const char *data)
+{
+	FILE *fp;
+
+	fp = fopen(file, "w");
+	if (!fp)
+		return -1;
+	fputs(data, fp);
+
+	return fclose(fp);
+}
+
+/* New mount namespace, with a tmpfs for the conditions */
+static void sandbox(void)
+{
+	uid_t uid = getuid();
+	gid_t gid = getgid();
+	int flags = CLONE_NEWNS;
+	char map[32];
+	char *run;
+
+	if (geteuid())
+		flags |= CLONE_NEWUSER;
+	if (unshare(flags))
+		err(1, "Failed creating namespace, requires root or user namespaces");
+
+	if (flags & CLONE_NEWUSER) {
+		snprintf(map, sizeof(map), "0 %d 1", uid);
+		if (writefile("/proc/self/uid_map", map))
+			err(1, "Failed setting up uid_map");
+		writefile("/proc/self/setgroups", "deny");
+		snprintf(map, sizeof(map), "0 %d 1", gid);
+		if (writefile("/proc/self/gid_map", map))
+			err(1, "Failed setting up gid_map");
+	}
+
+	/* Same logic as pid_runpath() */
+	run = fisdir("/run") ? "/run" : "/var/run";
+	if (mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) ||
+	    mount("tmpfs", run, "tmpfs", 0, "mode=0755"))
+		err(1, "Failed mounting tmpfs on %s", run);
+}
+
+static int usage(int rc)
+{
+	fprintf(stderr,
+		"Usage: %s [-h] [-c CONDS] [-m PER-SVC] [-n SVCS] [-r ROUNDS] [-R RELOADS]\n"
+		"\n"
+		"  -c CONDS    Number of conditions, default: %d\n"
+		"  -m PER-SVC  Conditions per service, default: %d\n"
+		"  -n SVCS     Number of services, default: %d\n"
+		"  -r ROUNDS   Number of condition flaps, default: %d\n"
+		"  -R RELOADS  Number of reloads, default: %d\n"
+		"\n", prognm, ncond, nper, nsvc, rounds, reloads);
+
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	svc_t *svc, *iter = NULL;
+	uev_ctx_t loop;
+	uint64_t start;
+	char name[32];
+	int c, i;
+
+	progname(argv[0]);
+	while ((c = getopt(argc, argv, "c:hm:n:r:R:")) != EOF) {
+		switch (c) {
+		case 'c':
+			ncond = atoi(optarg);
+			break;
+
+		case 'h':
+			return usage(0);
+
+		case 'm':
+			nper = atoi(optarg);
+			break;
+
+		case 'n':
+			nsvc = atoi(optarg);
+			break;
+
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+
+		case 'R':
+			reloads = atoi(optarg);
+			break;
+
+		default:
+			return usage(1);
+		}
+	}
+
+	if (ncond < 1 || nsvc < 1 || nper < 1 || nper > 16 || rounds < 0 || reloads < 0)
+		return usage(1);
+
+	sandbox();
+	if (uev_init(&loop))
+		err(1, "Failed creating event loop");
+	ctx = &loop;
+
+	cond_init();
+	sm_init(&sm);
+	srand(1);
+
+	/* N services with M conditions each, all waiting */
+	register_all(&ops[OP_REGISTER]);
+
+	start = prof_now();
+	sm_step(&sm);
+	op_add(&ops[OP_STEP_ALL], start);
+
+	/* Assert all conditions, services start */
+	for (i = 0; i < ncond; i++) {
+		cond_name(name, sizeof(name), i);
+		start = prof_now();
+		cond_set(name);
+		op_add(&ops[OP_COND_SET], start);
+	}
+
+	/* Condition flapping, affected services stop and start */
+	for (i = 0; i < rounds; i++) {
+		cond_name(name, sizeof(name), rand() % ncond);
+
+		start = prof_now();
+		cond_clear(name);
+		op_add(&ops[OP_COND_CLEAR], start);
+
+		reap(&ops[OP_SIGCHLD]);
+
+		start = prof_now();
+		cond_set(name);
+		op_add(&ops[OP_COND_SET], start);
+	}
+
+	/* Mass reload, until all services have been restarted */
+	for (i = 0; i < reloads; i++) {
+		start = prof_now();
+		service_reload_dynamic();
+		reap(NULL);
+
+		/* Like the netlink plugin does for net/ */
+		cond_reassert("usr/");
+		reap(NULL);
+		op_add(&ops[OP_RELOAD], start);
+	}
+
+	/* Mass SIGCHLD, all services crash at once */
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		if (svc->pid <= 0)
+			continue;
+
+		start = prof_now();
+		service_monitor(svc->pid, SIGSEGV);
+		op_add(&ops[OP_CRASH], start);
+	}
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		start = prof_now();
+		service_unregister(svc);
+		op_add(&ops[OP_UNREGISTER], start);
+		reap(NULL);
+	}
+
+	report();
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,390 @@
+/* Compiled cache of /etc/finit.conf and /etc/finit.d/<SVC>.conf
+ *
+ * Copyright (c) 2026  agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * The cache is a flat image of all directives in finit.conf, any include
+ * files, and all *.conf in finit.d/, with comments and empty lines
+ * removed.  It is keyed on the inode, size and timestamps of all files,
+ * and the finit.d/ directory itself, so any added, removed or modified
+ * file invalidates it.  The image is mmap()ed and replayed through the
+ * regular directive parsers, without reading or scanning any .conf.
+ *
+ *   [ header | keys[nkeys] | records[nrecs] | strings ]
+ *
+ * Offset zero in the string table is the empty string.
+ */
+
+#include "config.h"		/* Generated by configure script */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <lite/lite.h>
+
+#include "finit.h"
+#include "cache.h"
+#include "helpers.h"
+
+#define CACHE_MAGIC    "FCC"
+#define CACHE_VERSION  1
+
+struct cache_hdr {
+	char     magic[4];
+	uint32_t version;
+	uint32_t nkeys;
+	uint32_t nrecs;
+	uint32_t size;			/* Total size of image */
+};
+
+struct cache_key {
+	uint32_t path;			/* Offset in string table */
+	uint32_t exists;		/* 0: file must still be missing */
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t  mtime, mtime_ns;
+	int64_t  ctime, ctime_ns;
+};
+
+struct cache_rec {
+	uint32_t type;
+	uint32_t line;			/* Offset in string table */
+	uint32_t file;			/* Offset in string table, 0: none */
+};
+
+/* Used when compiling a new cache, while parsing all .conf files */
+static struct {
+	int               active;
+
+	struct cache_key *keys;
+	size_t            nkeys;
+	struct cache_rec *recs;
+	size_t            nrecs;
+
+	char             *str;
+	size_t            len;
+	size_t            size;
+	uint32_t          file;		/* Offset of last file */
+} cc;
+
+static void key_set(struct cache_key *key, struct stat *st)
+{
+	key->exists   = 1;
+	key->dev      = st->st_dev;
+	key->ino      = st->st_ino;
+	key->size     = st->st_size;
+	key->mtime    = st->st_mtim.tv_sec;
+	key->mtime_ns = st->st_mtim.tv_nsec;
+	key->ctime    = st->st_ctim.tv_sec;
+	key->ctime_ns = st->st_ctim.tv_nsec;
+}
+
+/* Is @key still valid, i.e., has the file not changed since we saved it? */
+static int key_valid(struct cache_key *key, char *path)
+{
+	struct cache_key now = { 0 };
+	struct stat st;
+
+	if (stat(path, &st))
+		return !key->exists;
+	if (!key->exists)
+		return 0;
+
+	key_set(&now, &st);
+	now.path = key->path;
+
+	return !memcmp(&now, key, sizeof(now));
+}
+
+static int cache_valid(char *img, size_t len)
+{
+	struct cache_hdr *hdr = (struct cache_hdr *)img;
+	struct cache_key *keys;
+	struct cache_rec *recs;
+	size_t off, strsz;
+	uint32_t i;
+
+	if (len < sizeof(*hdr) || memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)))
+		return 0;
+	if (hdr->version != CACHE_VERSION || hdr->size != len)
+		return 0;
+
+	off = sizeof(*hdr) + (size_t)hdr->nkeys * sizeof(*keys) + (size_t)hdr->nrecs * sizeof(*recs);
+	if (off >= len || img[len - 1] != 0)
+		return 0;
+	strsz = len - off;
+
+	keys = (struct cache_key *)&img[sizeof(*hdr)];
+	recs = (struct cache_rec *)&keys[hdr->nkeys];
+	for (i = 0; i < hdr->nrecs; i++) {
+		if (recs[i].line >= strsz || recs[i].file >= strsz)
+			return 0;
+	}
+
+	for (i = 0; i < hdr->nkeys; i++) {
+		char *path;
+
+		if (keys[i].path >= strsz)
+			return 0;
+
+		path = &img[off + keys[i].path];
+		if (!key_valid(&keys[i], path)) {
+			_d("Cache invalid, %s has changed.", path);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * cache_replay - Replay a valid .conf cache
+ * @cb: Callback for each record, see cache.h for record types
+ *
+ * Returns:
+ * POSIX OK(0) if a valid cache was replayed, otherwise non-zero and
+ * the caller must parse all .conf files.
+ */
+int cache_replay(cache_cb_t cb)
+{
+	struct cache_hdr *hdr;
+	struct cache_rec *recs;
+	struct stat st;
+	char *img, *str;
+	uint32_t i;
+	int fd;
+
+	fd = open(FINIT_CONF_CACHE, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 1;
+
+	if (fstat(fd, &st) || st.st_size <= 0) {
+		close(fd);
+		return 1;
+	}
+
+	img = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (img == MAP_FAILED)
+		return 1;
+
+	if (!cache_valid(img, st.st_size)) {
+		munmap(img, st.st_size);
+		return 1;
+	}
+
+	hdr  = (struct cache_hdr *)img;
+	recs = (struct cache_rec *)&img[sizeof(*hdr) + hdr->nkeys * sizeof(struct cache_key)];
+	str  = (char *)&recs[hdr->nrecs];
+
+	_d("Replaying %u records from %s", hdr->nrecs, FINIT_CONF_CACHE);
+	for (i = 0; i < hdr->nrecs; i++) {
+		char line[LINE_SIZE], file[LINE_SIZE];
+
+		/* The parsers modify their input, and the image is read-only */
+		strlcpy(line, &str[recs[i].line], sizeof(line));
+		strlcpy(file, &str[recs[i].file], sizeof(file));
+
+		cb(recs[i].type, line, recs[i].file ? file : NULL);
+	}
+
+	munmap(img, st.st_size);
+
+	return 0;
+}
+
+static uint32_t add_str(char *str)
+{
+	size_t len = strlen(str) + 1;
+	uint32_t off;
+
+	if (!str[0])
+		return 0;
+
+	if (cc.len + len > cc.size) {
+		size_t size = cc.size * 2 + len;
+		char *ptr;
+
+		ptr = realloc(cc.str, size);
+		if (!ptr) {
+			cc.active = 0;
+			return 0;
+		}
+		cc.str  = ptr;
+		cc.size = size;
+	}
+
+	off = cc.len;
+	memcpy(&cc.str[off], str, len);
+	cc.len += len;
+
+	return off;
+}
+
+static void cache_free(void)
+{
+	free(cc.keys);
+	free(cc.recs);
+	free(cc.str);
+	memset(&cc, 0, sizeof(cc));
+}
+
+/**
+ * cache_start - Start compiling a new .conf cache
+ *
+ * Any following cache_key() and cache_add() calls, from the parser,
+ * are recorded until cache_save().
+ */
+void cache_start(void)
+{
+	cache_free();
+
+	cc.active = 1;
+	cc.len    = 1;		/* The empty string */
+	cc.size   = 4096;
+	cc.str    = calloc(1, cc.size);
+	if (!cc.str)
+		cc.active = 0;
+}
+
+/**
+ * cache_key - Add a file, or directory, to the cache key
+ * @path: Path to file, may not exist
+ */
+void cache_key(char *path)
+{
+	struct cache_key *keys, *key;
+	struct stat st;
+
+	if (!cc.active)
+		return;
+
+	keys = realloc(cc.keys, (cc.nkeys + 1) * sizeof(*keys));
+	if (!keys) {
+		cc.active = 0;
+		return;
+	}
+	cc.keys = keys;
+
+	key = &keys[cc.nkeys++];
+	memset(key, 0, sizeof(*key));
+	if (!stat(path, &st))
+		key_set(key, &st);
+	key->path = add_str(path);
+}
+
+/**
+ * cache_add - Add a record to the cache
+ * @type: Record type, see cache.h
+ * @line: Directive, after comments and tabs have been handled, or %NULL
+ * @file: The .conf file in finit.d/, or %NULL for finit.conf
+ */
+void cache_add(int type, char *line, char *file)
+{
+	struct cache_rec *recs, *rec;
+
+	if (!cc.active)
+		return;
+
+	if (cc.nrecs % 64 == 0) {
+		recs = realloc(cc.recs, (cc.nrecs + 64) * sizeof(*recs));
+		if (!recs) {
+			cc.active = 0;
+			return;
+		}
+		cc.recs = recs;
+	}
+
+	rec = &cc.recs[cc.nrecs++];
+	rec->type = type;
+	rec->line = line ? add_str(line) : 0;
+	rec->file = 0;
+	if (file) {
+		/* Usually many records in a row from the same file */
+		if (!cc.file || strcmp(&cc.str[cc.file], file))
+			cc.file = add_str(file);
+		rec->file = cc.file;
+	}
+}
+
+/**
+ * cache_save - Save compiled .conf cache
+ *
+ * A failure to save, e.g. on a read-only file system, is not an error.
+ * The cache is replaced atomically, so a half-written cache is never
+ * used.  On write errors any old cache is removed, it is stale anyway.
+ */
+void cache_save(void)
+{
+	struct cache_hdr hdr = { CACHE_MAGIC, CACHE_VERSION, 0, 0, 0 };
+	char tmp[sizeof(FINIT_CONF_CACHE) + 4];
+	FILE *fp;
+
+	if (!cc.active) {
+		_d("Failed compiling .conf cache.");
+		goto done;
+	}
+
+	hdr.nkeys = cc.nkeys;
+	hdr.nrecs = cc.nrecs;
+	hdr.size  = sizeof(hdr) + cc.nkeys * sizeof(*cc.keys) + cc.nrecs * sizeof(*cc.recs) + cc.len;
+
+	snprintf(tmp, sizeof(tmp), "%s.new", FINIT_CONF_CACHE);
+	fp = fopen(tmp, "we");
+	if (!fp) {
+		_d("Cannot save .conf cache %s: %s", tmp, strerror(errno));
+		goto done;
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    (cc.nkeys && fwrite(cc.keys, sizeof(*cc.keys), cc.nkeys, fp) != cc.nkeys) ||
+	    (cc.nrecs && fwrite(cc.recs, sizeof(*cc.recs), cc.nrecs, fp) != cc.nrecs) ||
+	    fwrite(cc.str, cc.len, 1, fp) != 1) {
+		fclose(fp);
+		goto fail;
+	}
+
+	if (fclose(fp) || rename(tmp, FINIT_CONF_CACHE))
+		goto fail;
+
+	_d("Saved %zu records to %s", cc.nrecs, FINIT_CONF_CACHE);
+	goto done;
+fail:
+	logit(LOG_WARNING, "Failed saving .conf cache %s: %s", FINIT_CONF_CACHE, strerror(errno));
+	erase(tmp);
+	erase(FINIT_CONF_CACHE);
+done:
+	cache_free();
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
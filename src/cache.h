@@ -0,0 +1,61 @@
+/* Compiled cache of /etc/finit.conf and /etc/finit.d/<SVC>.conf
+ *
+ * Copyright (c) 2026  agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_CACHE_H_
+#define FINIT_CACHE_H_
+
+/* Record types, replayed in order by the .conf parser */
+enum {
+	CACHE_CONF_BEGIN = 1,	/* finit.conf, or include file: get global rlimits */
+	CACHE_CONF_LINE,	/* Static or dynamic directive in finit.conf */
+	CACHE_CONF_END,		/* End of finit.conf: set global rlimits */
+	CACHE_FILE_BEGIN,	/* finit.d/ *.conf: start from global rlimits */
+	CACHE_FILE_LINE,	/* Dynamic directive in finit.d/ *.conf */
+};
+
+typedef void (*cache_cb_t)(int type, char *line, char *file);
+
+#ifdef FINIT_CONF_CACHE
+int  cache_replay (cache_cb_t cb);
+
+void cache_start  (void);
+void cache_key    (char *path);
+void cache_add    (int type, char *line, char *file);
+void cache_save   (void);
+#else
+static inline int  cache_replay (cache_cb_t cb) { return 1; }
+
+static inline void cache_start  (void) { }
+static inline void cache_key    (char *path) { }
+static inline void cache_add    (int type, char *line, char *file) { }
+static inline void cache_save   (void) { }
+#endif
+
+#endif /* FINIT_CACHE_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
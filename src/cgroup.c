@@ -0,0 +1,407 @@
+/* cgroup v2 support, one cgroup per service
+ *
+ * Copyright (c) 2026  agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Each service runs in its own cgroup, FINIT_CGROUP_SVC/<name>, where
+ * <name> is the basename of the command and its unique JOB:ID, so that
+ * /usr/sbin/foo and /opt/bin/foo never share a group.
+ * All connections of an inetd service share the cgroup of the service.
+ *
+ * The cpu, memory, io, and pids controllers are delegated, when the
+ * kernel has them, and any cgroup.FILE:VALUE settings of a service are
+ * written to the cgroup when it is (re)created at service start.
+ */
+
+#include "config.h"		/* Generated by configure script */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#include <lite/lite.h>
+
+#include "finit.h"
+#include "cgroup.h"
+#include "helpers.h"
+#include "log.h"
+
+static int enabled = 0;
+static char *controllers[] = { "cpu", "memory", "io", "pids" };
+
+/* All connections of an inetd service share one cgroup */
+static char *cgroup_name(svc_t *svc, char *buf, size_t len)
+{
+	if (svc_is_inetd_conn(svc) && svc->inetd.svc)
+		svc = svc->inetd.svc;
+
+	snprintf(buf, len, "%s@%d:%d", basename(svc->cmd), svc->job, svc->id);
+
+	return buf;
+}
+
+static char *cgroup_path(svc_t *svc, char *buf, size_t len)
+{
+	char name[sizeof(svc->cmd) + 12];
+
+	snprintf(buf, len, "%s/%s", FINIT_CGROUP_SVC, cgroup_name(svc, name, sizeof(name)));
+
+	return buf;
+}
+
+static int cgwrite(char *path, char *file, char *val)
+{
+	char fn[PATH_MAX];
+	ssize_t len;
+	int fd;
+
+	snprintf(fn, sizeof(fn), "%s/%s", path, file);
+	fd = open(fn, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	len = write(fd, val, strlen(val));
+	close(fd);
+
+	return len < 0 ? -1 : 0;
+}
+
+static FILE *cgopen(char *path, char *file)
+{
+	char fn[PATH_MAX];
+
+	snprintf(fn, sizeof(fn), "%s/%s", path, file);
+
+	return fopen(fn, "r");
+}
+
+/**
+ * cgroup_init - Set up cgroup v2 hierarchy for services
+ *
+ * Mounts the unified hierarchy on FINIT_CGROUP, unless something is
+ * already mounted there, creates the top-level group for services and
+ * delegates the available controllers to it.
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero if cgroups are not available, in
+ * which case services are started without them.
+ */
+int cgroup_init(void)
+{
+	struct statfs sfs;
+	size_t i;
+
+	if (statfs(FINIT_CGROUP, &sfs)) {
+		_pe("Cannot find %s, no cgroup support in kernel?", FINIT_CGROUP);
+		return 1;
+	}
+
+	if (sfs.f_type == SYSFS_MAGIC) {
+		if (mount("cgroup2", FINIT_CGROUP, "cgroup2", MS_NOSUID | MS_NODEV | MS_NOEXEC, NULL)) {
+			_pe("Failed mounting cgroup v2 hierarchy on %s", FINIT_CGROUP);
+			return 1;
+		}
+	} else if (sfs.f_type != CGROUP2_SUPER_MAGIC) {
+		_w("%s is not a cgroup v2 hierarchy, cgroups disabled.", FINIT_CGROUP);
+		return 1;
+	}
+
+	if (mkdir(FINIT_CGROUP_SVC, 0755) && errno != EEXIST) {
+		_pe("Failed creating %s", FINIT_CGROUP_SVC);
+		return 1;
+	}
+
+	/* One at a time, the kernel may not have all of them */
+	for (i = 0; i < NELEMS(controllers); i++) {
+		char val[16];
+
+		snprintf(val, sizeof(val), "+%s", controllers[i]);
+		if (cgwrite(FINIT_CGROUP, "cgroup.subtree_control", val) ||
+		    cgwrite(FINIT_CGROUP_SVC, "cgroup.subtree_control", val))
+			_d("Controller %s not available.", controllers[i]);
+	}
+
+	enabled = 1;
+
+	return 0;
+}
+
+/**
+ * cgroup_service - Create cgroup of service and apply its settings
+ * @svc: Service about to be started
+ *
+ * Called by service_start() before forking.  The cgroup of a service
+ * is recreated, if empty, so settings removed from a .conf file since
+ * the last start do not linger.  Shared cgroups of inetd connections
+ * are only set up by the first connection.
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero on error.
+ */
+int cgroup_service(svc_t *svc)
+{
+	char path[PATH_MAX], settings[MAX_COND_LEN];
+	char *opt, *val, *ptr;
+
+	if (!enabled)
+		return 1;
+
+	cgroup_path(svc, path, sizeof(path));
+	if (!svc_is_inetd_conn(svc))
+		rmdir(path);
+
+	if (mkdir(path, 0755)) {
+		if (errno != EEXIST) {
+			logit(LOG_WARNING, "%s: failed creating cgroup %s: %m", svc->cmd, path);
+			return 1;
+		}
+		if (svc_is_inetd_conn(svc))
+			return 0;
+	}
+
+	strlcpy(settings, svc_cgroup(svc), sizeof(settings));
+	for (opt = strtok_r(settings, " ", &ptr); opt; opt = strtok_r(NULL, " ", &ptr)) {
+		char *sep;
+
+		val = strchr(opt, ':');
+		if (!val)
+			continue;
+		*val++ = 0;
+
+		/* io.max:8:0,rbps=1048576 --> "8:0 rbps=1048576" */
+		for (sep = val; (sep = strchr(sep, ',')); sep++)
+			*sep = ' ';
+
+		_d("%s: cgroup %s = %s", svc->cmd, opt, val);
+		if (cgwrite(path, opt, val))
+			logit(LOG_WARNING, "%s: failed setting cgroup %s to %s: %m", svc->cmd, opt, val);
+	}
+
+	return 0;
+}
+
+/**
+ * cgroup_enter - Move calling process to the cgroup of a service
+ * @svc: Service being started
+ *
+ * Called in the child, before exec, so all processes the service may
+ * spawn are accounted for.
+ */
+void cgroup_enter(svc_t *svc)
+{
+	char path[PATH_MAX];
+
+	if (!enabled)
+		return;
+
+	cgroup_path(svc, path, sizeof(path));
+	if (cgwrite(path, "cgroup.procs", "0"))
+		logit(LOG_WARNING, "%s: failed moving to cgroup %s: %m", svc->cmd, path);
+}
+
+/**
+ * cgroup_signal - Send signal to all processes of a service
+ * @svc:   Service to signal
+ * @signo: Signal to send
+ *
+ * SIGKILL uses cgroup.kill, on kernels that lack it (< 5.14), and for
+ * all other signals, every process in cgroup.procs is signalled.  Note,
+ * connections of an inetd service share a cgroup, so this signals all
+ * of them.
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero if the service has no cgroup.
+ */
+int cgroup_signal(svc_t *svc, int signo)
+{
+	char path[PATH_MAX], line[32];
+	FILE *fp;
+
+	if (!enabled)
+		return 1;
+
+	cgroup_path(svc, path, sizeof(path));
+	if (signo == SIGKILL && !cgwrite(path, "cgroup.kill", "1"))
+		return 0;
+
+	fp = cgopen(path, "cgroup.procs");
+	if (!fp)
+		return 1;
+
+	while (fgets(line, sizeof(line), fp)) {
+		pid_t pid = atoi(line);
+
+		if (pid > 1)
+			kill(pid, signo);
+	}
+	fclose(fp);
+
+	return 0;
+}
+
+/**
+ * cgroup_populated - Check if any process of a service is still alive
+ * @svc: Service to check
+ *
+ * Returns:
+ * 1 if there are processes left in the cgroup, 0 if it is empty, and
+ * -1 if the service has no cgroup.
+ */
+int cgroup_populated(svc_t *svc)
+{
+	char path[PATH_MAX], line[32];
+	int populated = -1;
+	FILE *fp;
+
+	if (!enabled)
+		return -1;
+
+	cgroup_path(svc, path, sizeof(path));
+	fp = cgopen(path, "cgroup.events");
+	if (!fp)
+		return -1;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "populated %d", &populated) == 1)
+			break;
+	}
+	fclose(fp);
+
+	return populated;
+}
+
+/**
+ * cgroup_remove - Remove cgroup of a service
+ * @svc: Service being removed
+ *
+ * Fails silently if there are processes left in the cgroup.  Shared
+ * cgroups of inetd connections are removed with the inetd service.
+ */
+void cgroup_remove(svc_t *svc)
+{
+	char path[PATH_MAX];
+
+	if (!enabled || svc_is_inetd_conn(svc))
+		return;
+
+	cgroup_path(svc, path, sizeof(path));
+	if (rmdir(path) && errno != ENOENT)
+		_d("Cannot remove %s: %m", path);
+}
+
+static uint64_t cgvalue(char *path, char *file)
+{
+	char line[32];
+	uint64_t val = 0;
+	FILE *fp;
+
+	fp = cgopen(path, file);
+	if (!fp)
+		return 0;
+
+	if (fgets(line, sizeof(line), fp)) {
+		if (!strncmp(line, "max", 3))
+			val = UINT64_MAX;
+		else
+			val = strtoull(line, NULL, 10);
+	}
+	fclose(fp);
+
+	return val;
+}
+
+/**
+ * cgroup_stat - Read resource usage of a service
+ * @svc: Service to query
+ * @st:  Pointer to stats, zeroed first
+ *
+ * Counters of controllers not available are left as zero.
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero if the service has no cgroup.
+ */
+int cgroup_stat(svc_t *svc, cgroup_stat_t *st)
+{
+	char path[PATH_MAX], line[256];
+	FILE *fp;
+
+	memset(st, 0, sizeof(*st));
+	if (!enabled)
+		return 1;
+
+	cgroup_name(svc, st->name, sizeof(st->name));
+	cgroup_path(svc, path, sizeof(path));
+
+	fp = cgopen(path, "cgroup.procs");
+	if (!fp)
+		return 1;
+	while (fgets(line, sizeof(line), fp))
+		st->nprocs++;
+	fclose(fp);
+
+	fp = cgopen(path, "cpu.stat");
+	if (fp) {
+		while (fgets(line, sizeof(line), fp)) {
+			sscanf(line, "usage_usec %" SCNu64, &st->cpu_usec);
+			sscanf(line, "user_usec %" SCNu64, &st->cpu_user);
+			sscanf(line, "system_usec %" SCNu64, &st->cpu_system);
+		}
+		fclose(fp);
+	}
+
+	st->mem_current = cgvalue(path, "memory.current");
+	st->mem_max     = cgvalue(path, "memory.max");
+
+	/* 8:0 rbytes=1459200 wbytes=314773504 rios=192 wios=353 ... */
+	fp = cgopen(path, "io.stat");
+	if (fp) {
+		while (fgets(line, sizeof(line), fp)) {
+			char *tok, *ptr;
+
+			for (tok = strtok_r(line, " \n", &ptr); tok; tok = strtok_r(NULL, " \n", &ptr)) {
+				if (!strncmp(tok, "rbytes=", 7))
+					st->io_rbytes += strtoull(&tok[7], NULL, 10);
+				else if (!strncmp(tok, "wbytes=", 7))
+					st->io_wbytes += strtoull(&tok[7], NULL, 10);
+			}
+		}
+		fclose(fp);
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
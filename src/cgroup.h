@@ -0,0 +1,78 @@
+/* cgroup v2 support, one cgroup per service
+ *
+ * Copyright (c) 2026  agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_CGROUP_H_
+#define FINIT_CGROUP_H_
+
+#include <stdint.h>
+#include "svc.h"
+
+#define FINIT_CGROUP     "/sys/fs/cgroup"
+#define FINIT_CGROUP_SVC FINIT_CGROUP "/finit"
+
+/*
+ * Resource usage of a service, and all its children, sent as-is to
+ * initctl in the data field of the init_request, see api.c
+ */
+typedef struct {
+	char     name[64];	/* Relative to FINIT_CGROUP_SVC */
+	int      nprocs;	/* Processes in cgroup.procs */
+	uint64_t cpu_usec;	/* cpu.stat: usage_usec */
+	uint64_t cpu_user;	/* cpu.stat: user_usec */
+	uint64_t cpu_system;	/* cpu.stat: system_usec */
+	uint64_t mem_current;	/* memory.current */
+	uint64_t mem_max;	/* memory.max, UINT64_MAX if unlimited */
+	uint64_t io_rbytes;	/* io.stat: rbytes, all devices */
+	uint64_t io_wbytes;	/* io.stat: wbytes, all devices */
+} cgroup_stat_t;
+
+#ifdef CGROUP_ENABLED
+int  cgroup_init    (void);
+
+int  cgroup_service (svc_t *svc);
+void cgroup_enter   (svc_t *svc);
+int  cgroup_signal  (svc_t *svc, int signo);
+int  cgroup_populated(svc_t *svc);
+void cgroup_remove  (svc_t *svc);
+
+int  cgroup_stat    (svc_t *svc, cgroup_stat_t *st);
+#else
+static inline int  cgroup_init    (void)        { return 0; }
+
+static inline int  cgroup_service (svc_t *svc)  { return 0; }
+static inline void cgroup_enter   (svc_t *svc)  { }
+static inline int  cgroup_signal  (svc_t *svc, int signo) { return 1; }
+static inline int  cgroup_populated(svc_t *svc) { return -1; }
+static inline void cgroup_remove  (svc_t *svc)  { }
+
+static inline int  cgroup_stat    (svc_t *svc, cgroup_stat_t *st) { return 1; }
+#endif
+
+#endif /* FINIT_CGROUP_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -89,6 +89,60 @@ exit:
 	return result;
 }
 
+static int readn(int sd, void *buf, size_t len)
+{
+	char *ptr = buf;
+
+	while (len > 0) {
+		ssize_t num;
+
+		num = read(sd, ptr, len);
+		if (num <= 0) {
+			if (num < 0 && errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		ptr += num;
+		len -= num;
+	}
+
+	return 0;
+}
+
+/*
+ * Receive an &svc_t followed by its &svc_conf_t, see send_svc() in
+ * api.c.  The record is stored in @conf, which is grown as needed.
+ */
+static int client_svc_recv(int sd, svc_t *svc, svc_conf_t **conf)
+{
+	svc_conf_t hdr, *ptr;
+
+	if (readn(sd, svc, sizeof(*svc)))
+		return -1;
+
+	svc->conf = NULL;
+	if (svc->pid < 0)
+		return 0;
+
+	if (readn(sd, &hdr, SVC_CONF_HDR) || hdr.len < SVC_CONF_HDR + 1 ||
+	    hdr.len > UINT16_MAX + SVC_CONF_HDR)
+		return -1;
+
+	/* The strings start at the end of the header, not at sizeof(hdr) */
+	ptr = realloc(*conf, sizeof(hdr) + hdr.len - SVC_CONF_HDR);
+	if (!ptr)
+		return -1;
+	*conf = ptr;
+
+	memcpy(ptr, &hdr, SVC_CONF_HDR);
+	if (readn(sd, ptr->str, hdr.len - SVC_CONF_HDR))
+		return -1;
+	svc->conf = ptr;
+
+	return 0;
+}
+
 svc_t *client_svc_iterator(int first)
 {
 	int sd = -1;
@@ -96,6 +150,7 @@ svc_t *client_svc_iterator(int first)
 		.magic = INIT_MAGIC,
 		.cmd   = INIT_CMD_SVC_ITER,
 	};
+	static svc_conf_t *conf = NULL;
 	static svc_t svc;
 
 	sd = client_connect();
@@ -109,7 +164,7 @@ svc_t *client_svc_iterator(int first)
 
 	if (write(sd, &rq, sizeof(rq)) != sizeof(rq))
 		goto error;
-	if (read(sd, &svc, sizeof(svc)) != sizeof(svc))
+	if (client_svc_recv(sd, &svc, &conf))
 		goto error;
 
 	client_disconnect();
@@ -132,6 +187,7 @@ svc_t *client_svc_find(char *arg)
 		.magic = INIT_MAGIC,
 		.cmd   = INIT_CMD_SVC_FIND,
 	};
+	static svc_conf_t *conf = NULL;
 	static svc_t svc;
 
 	sd = client_connect();
@@ -141,7 +197,7 @@ svc_t *client_svc_find(char *arg)
 	strlcpy(rq.data, arg, sizeof(rq.data));
 	if (write(sd, &rq, sizeof(rq)) != sizeof(rq))
 		goto error;
-	if (read(sd, &svc, sizeof(svc)) != sizeof(svc))
+	if (client_svc_recv(sd, &svc, &conf))
 		goto error;
 
 	client_disconnect();
@@ -157,6 +213,47 @@ error:
 	return NULL;
 }
 
+/*
+ * Fetch the event loop handler stats, see prof_send() in prof.c.  The
+ * array returned in @arr must be freed by the caller.
+ */
+int client_debug_stats(int reset, prof_t **arr)
+{
+	int sd = -1, num = 0;
+	struct init_request rq = {
+		.magic    = INIT_MAGIC,
+		.cmd      = INIT_CMD_DEBUG_STATS,
+		.runlevel = reset,
+	};
+
+	*arr = NULL;
+	sd = client_connect();
+	if (sd == -1)
+		return -1;
+
+	if (write(sd, &rq, sizeof(rq)) != sizeof(rq))
+		goto error;
+	if (readn(sd, &num, sizeof(num)) || num < 0 || num > PROF_MAX)
+		goto error;
+
+	if (num) {
+		*arr = calloc(num, sizeof(prof_t));
+		if (!*arr || readn(sd, *arr, num * sizeof(prof_t)))
+			goto error;
+	}
+
+	client_disconnect();
+
+	return num;
+error:
+	client_disconnect();
+	perror("Failed communicating with finit");
+	free(*arr);
+	*arr = NULL;
+
+	return -1;
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
@@ -25,6 +25,7 @@
 #define FINIT_CLIENT_H_
 
 #include "finit.h"
+#include "prof.h"
 #include "svc.h"
 
 int    client_connect      (void);
@@ -33,5 +34,6 @@ int    client_disconnect   (void);
 int    client_send         (struct init_request *rq, ssize_t len);
 svc_t *client_svc_iterator (int first);
 svc_t *client_svc_find     (char *arg);
+int    client_debug_stats  (int reset, prof_t **arr);
 
 #endif /* FINIT_CLIENT_H_ */
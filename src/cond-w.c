@@ -117,7 +117,7 @@ int cond_set_path(const char *path, enum cond_state new)
 /* Has condition in configuration and cond is allowed? */
 static int svc_has_cond(svc_t *svc)
 {
-	if (!svc->cond[0])
+	if (!svc_cond(svc)[0])
 		return 0;
 
 	switch (svc->type) {
@@ -139,10 +139,10 @@ static void cond_update(const char *name)
 
 	_d("%s", name);
 	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
-		if (!svc_has_cond(svc) || !cond_affects(name, svc->cond))
+		if (!svc_has_cond(svc) || !cond_affects(name, svc_cond(svc)))
 			continue;
 
-		_d("%s: match <%s> %s(%s)", name ?: "nil", svc->cond, svc->desc, svc->cmd);
+		_d("%s: match <%s> %s(%s)", name ?: "nil", svc_cond(svc), svc_desc(svc), svc->cmd);
 		service_step(svc);
 	}
 }
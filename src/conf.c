@@ -23,6 +23,7 @@
 
 #include "config.h"		/* Generated by configure script */
 
+#include <ctype.h>		/* isblank() */
 #include <dirent.h>
 #include <string.h>
 #include <sys/inotify.h>
@@ -32,11 +33,14 @@
 #include <sys/time.h>
 
 #include "finit.h"
+#include "cache.h"
 #include "cond.h"
+#include "prof.h"
 #include "service.h"
 #include "tty.h"
 #include "helpers.h"
 #include "util.h"
+#include "watchdog.h"
 
 #define BOOTSTRAP (runlevel == 0)
 #define MATCH_CMD(l, c, x) \
@@ -47,15 +51,34 @@ int logfile_count_max = 5;
 
 struct rlimit global_rlimit[RLIMIT_NLIMITS];
 
+/*
+ * Changed .conf files since last reload, in order of first change, and
+ * hashed on name for lookups from the inotify callback and the parser.
+ */
+#define CONF_HASH_SIZE 64
+
 struct conf_change {
 	TAILQ_ENTRY(conf_change) link;
-	char *name;
+	LIST_ENTRY(conf_change)  hlink;
+	char name[];
 };
 
-static uev_t w1, w2, w3;
 static TAILQ_HEAD(head, conf_change) conf_change_list = TAILQ_HEAD_INITIALIZER(conf_change_list);
+static LIST_HEAD(, conf_change) conf_change_hash[CONF_HASH_SIZE];
+static int conf_overflow;	/* Lost inotify events, reload all */
+
+/* One inotify descriptor for /etc/finit.d, finit.d/available and finit.conf */
+static uev_t conf_watcher;
+static int   wd_rcsd = -1, wd_avail = -1, wd_conf = -1;
+
+/* Reload automatically when a burst of changes has settled, 0: disabled */
+static int   autoreload;
+static uev_t reload_timer;
+static int   reload_timer_armed;
+static uev_ctx_t *conf_ctx;
 
 static int parse_conf(char *file);
+static struct conf_change *conf_find(char *file);
 static void drop_changes(void);
 
 void conf_parse_cmdline(void)
@@ -177,7 +200,7 @@ int conf_parse_runlevels(char *runlevels)
 	return bitmask;
 }
 
-void conf_parse_cond(svc_t *svc, char *cond)
+void conf_parse_cond(svc_t *svc, svc_conf_buf_t *buf, char *cond)
 {
 	size_t i = 0;
 	char *ptr;
@@ -205,12 +228,12 @@ void conf_parse_cond(svc_t *svc, char *cond)
 		i++;
 	ptr[i] = 0;
 
-	if (i >= sizeof(svc->cond)) {
+	if (i >= sizeof(buf->cond)) {
 		logit(LOG_WARNING, "Too long event list in declaration of %s: %s", svc->cmd, ptr);
 		return;
 	}
 
-	strlcpy(svc->cond, ptr, sizeof(svc->cond));
+	strlcpy(buf->cond, ptr, sizeof(buf->cond));
 }
 
 struct rlimit_name {
@@ -369,8 +392,26 @@ static void parse_static(char *line)
 	}
 
 	if (BOOTSTRAP && MATCH_CMD(line, "runparts ", x)) {
+		char *dir = strip_line(x);
+
+		/* runparts [jobs:N] DIR */
+		runparts_jobs = 1;
+		if (!strncmp(dir, "jobs:", 5)) {
+			const char *errstr;
+			char *arg = strsep(&dir, " \t");
+
+			runparts_jobs = strtonum(arg + 5, 1, 64, &errstr);
+			if (errstr) {
+				_e("runparts: invalid number of jobs '%s', using one.", arg + 5);
+				runparts_jobs = 1;
+			}
+			if (!dir)
+				return;
+			dir = strip_line(dir);
+		}
+
 		if (runparts) free(runparts);
-		runparts = strdup(strip_line(x));
+		runparts = strdup(dir);
 		return;
 	}
 
@@ -380,6 +421,8 @@ static void parse_static(char *line)
 		strlcpy(cmd, file, sizeof(cmd));
 		if (!fexist(cmd)) {
 			_e("Cannot find include file %s, absolute path required!", x);
+			/* Key it anyway, the cache is stale if it appears later */
+			cache_key(cmd);
 			return;
 		}
 
@@ -407,6 +450,28 @@ static void parse_static(char *line)
 			logfile_count_max = count;
 	}
 
+	/* autoreload [MSEC], delay after last change, default 500 msec */
+	if (MATCH_CMD(line, "autoreload", x)) {
+		const char *err = NULL;
+		char *delay = strtok(strip_line(x), " ");
+
+		autoreload = 500;
+		if (delay) {
+			autoreload = strtonum(delay, 0, 3600000, &err);
+			if (err) {
+				logit(LOG_WARNING, "autoreload: invalid delay %s", delay);
+				autoreload = 500;
+			}
+		}
+		return;
+	}
+
+	if (BOOTSTRAP && MATCH_CMD(line, "watchdog ", x)) {
+		if (watchdog_conf(strip_line(x)) == ENOTSUP)
+			_e("watchdog: Finit built without built-in watchdog support");
+		return;
+	}
+
 	if (MATCH_CMD(line, "shutdown ", x)) {
 		if (sdown) free(sdown);
 		sdown = strdup(strip_line(x));
@@ -473,6 +538,16 @@ static void parse_dynamic(char *line, struct rlimit rlimit[], char *file)
 		return;
 	}
 
+	/* Inetd service redirected to a backend ADDR:PORT */
+	if (MATCH_CMD(line, "redir ", x)) {
+#ifdef INETD_ENABLED
+		service_register(SVC_TYPE_REDIR, x, rlimit, file);
+#else
+		_e("Finit built with inetd support disabled, cannot register service redir %s!", x);
+#endif
+		return;
+	}
+
 	/* Read resource limits */
 	if (MATCH_CMD(line, "rlimit ", x)) {
 		conf_parse_rlimit(x, rlimit);
@@ -497,11 +572,21 @@ static void tabstospaces(char *line)
 	}
 }
 
+/* Comments and empty lines need not be cached */
+static int is_directive(char *line)
+{
+	while (isblank(*line))
+		line++;
+
+	return *line && *line != '#';
+}
+
 static int parse_conf_dynamic(char *file)
 {
 	FILE *fp;
 	struct rlimit rlimit[RLIMIT_NLIMITS];
 
+	cache_key(file);
 	fp = fopen(file, "r");
 	if (!fp) {
 		_pe("Failed opening %s", file);
@@ -510,6 +595,7 @@ static int parse_conf_dynamic(char *file)
 
 	/* Prepare default limits for each service */
 	memcpy(rlimit, global_rlimit, sizeof(rlimit));
+	cache_add(CACHE_FILE_BEGIN, NULL, file);
 
 	_d("Parsing %s <<<<<<", file);
 	while (!feof(fp)) {
@@ -522,6 +608,8 @@ static int parse_conf_dynamic(char *file)
 		tabstospaces(line);
 		_d("%s", line);
 
+		if (is_directive(line))
+			cache_add(CACHE_FILE_LINE, line, file);
 		parse_dynamic(line, rlimit, file);
 	}
 
@@ -530,19 +618,36 @@ static int parse_conf_dynamic(char *file)
 	return 0;
 }
 
+/*
+ * Get current global limits, which may be overridden from both
+ * finit.conf, for Finit and its services like inetd+getty, and
+ * *.conf in finit.d/, for each service(s) listed there.
+ */
+static void get_global_rlimit(void)
+{
+	for (int i = 0; i < RLIMIT_NLIMITS; i++)
+		getrlimit(i, &global_rlimit[i]);
+}
+
+static void set_global_rlimit(void)
+{
+	for (int i = 0; i < RLIMIT_NLIMITS; i++) {
+		if (setrlimit(i, &global_rlimit[i]) == -1)
+			logit(LOG_WARNING, "rlimit: Failed setting %s: %s",
+			      rlim2str(i), lim2str(&global_rlimit[i]));
+	}
+}
+
 static int parse_conf(char *file)
 {
 	FILE *fp;
 	char line[LINE_SIZE] = "";
+	char *x;
 
-	/*
-	 * Get current global limits, which may be overridden from both
-	 * finit.conf, for Finit and its services like inetd+getty, and
-	 * *.conf in finit.d/, for each service(s) listed there.
-	 */
-	for (int i = 0; i < RLIMIT_NLIMITS; i++)
-		getrlimit(i, &global_rlimit[i]);
+	get_global_rlimit();
+	cache_add(CACHE_CONF_BEGIN, NULL, NULL);
 
+	cache_key(file);
 	fp = fopen(file, "r");
 	if (!fp)
 		return 1;
@@ -556,6 +661,10 @@ static int parse_conf(char *file)
 		tabstospaces(line);
 		_d("%s", line);
 
+		/* Included files are cached as well, instead of the include */
+		if (is_directive(line) && !MATCH_CMD(line, "include ", x))
+			cache_add(CACHE_CONF_LINE, line, NULL);
+
 		parse_static(line);
 		parse_dynamic(line, global_rlimit, NULL);
 	}
@@ -563,19 +672,88 @@ static int parse_conf(char *file)
 	fclose(fp);
 
 	/* Set global limits */
-	for (int i = 0; i < RLIMIT_NLIMITS; i++) {
-		if (setrlimit(i, &global_rlimit[i]) == -1)
-			logit(LOG_WARNING, "rlimit: Failed setting %s: %s",
-			      rlim2str(i), lim2str(&global_rlimit[i]));
-	}
+	set_global_rlimit();
+	cache_add(CACHE_CONF_END, NULL, NULL);
 
 	return 0;
 }
 
+/* Replay a record from the .conf cache, like parse_conf() et al. */
+static void replay(int type, char *line, char *file)
+{
+	static struct rlimit rlimit[RLIMIT_NLIMITS];
+
+	switch (type) {
+	case CACHE_CONF_BEGIN:
+		get_global_rlimit();
+		break;
+
+	case CACHE_CONF_LINE:
+		parse_static(line);
+		parse_dynamic(line, global_rlimit, NULL);
+		break;
+
+	case CACHE_CONF_END:
+		set_global_rlimit();
+		break;
+
+	case CACHE_FILE_BEGIN:
+		memcpy(rlimit, global_rlimit, sizeof(rlimit));
+		break;
+
+	case CACHE_FILE_LINE:
+		parse_dynamic(line, rlimit, file);
+		break;
+	}
+}
+
+/*
+ * Check that it's an actual file ... beyond any symlinks, ending with
+ * '.conf', in /etc/finit.d/
+ */
+static int is_conf(char *path)
+{
+	size_t len;
+	struct stat st;
+
+	if (lstat(path, &st)) {
+		_d("Skipping %s, cannot access: %s", path, strerror(errno));
+		return 0;
+	}
+
+	/* Skip directories */
+	if (S_ISDIR(st.st_mode)) {
+		_d("Skipping directory %s", path);
+		return 0;
+	}
+
+	/* Check for dangling symlinks */
+	if (S_ISLNK(st.st_mode)) {
+		char *rp;
+
+		rp = realpath(path, NULL);
+		if (!rp) {
+			logit(LOG_WARNING, "Skipping %s, dangling symlink: %s", path, strerror(errno));
+			return 0;
+		}
+
+		free(rp);
+	}
+
+	/* Check that file ends with '.conf' */
+	len = strlen(path);
+	if (len < 6 || strcmp(&path[len - 5], ".conf")) {
+		_d("Skipping %s, not a valid .conf ... ", path);
+		return 0;
+	}
+
+	return 1;
+}
+
 /*
  * Reload /etc/finit.conf and all *.conf in /etc/finit.d/
  */
-int conf_reload(void)
+static void reload_all(void)
 {
 	int i, num;
 	struct dirent **e;
@@ -584,23 +762,19 @@ int conf_reload(void)
 	svc_mark_dynamic();
 	tty_mark();
 
-	if (rescue) {
-		int rc;
-		char line[80] = "tty [12345] @console noclear nologin";
-
-		/* If rescue.conf is missing, fall back to a root shell */
-		rc = parse_conf(RESCUE_CONF);
-		if (rc)
-			tty_register(line, global_rlimit, NULL);
+	/* Global settings, until set again in finit.conf */
+	autoreload = 0;
 
-		print(rc, "Entering rescue mode");
-		goto done;
-	}
+	/* Use compiled cache, if no .conf has changed since it was saved */
+	if (!cache_replay(replay))
+		return;
+	cache_start();
 
 	/* First, read /etc/finit.conf */
 	parse_conf(FINIT_CONF);
 
 	/* Next, read all *.conf in /etc/finit.d/ */
+	cache_key(rcsd);
 	num = scandir(rcsd, &e, NULL, alphasort);
 	if (num < 0) {
 		_d("Skipping %s, no files found ...", rcsd);
@@ -608,55 +782,94 @@ int conf_reload(void)
 	}
 
 	for (i = 0; i < num; i++) {
-		char *name = e[i]->d_name;
-		char  path[LINE_SIZE];
-		size_t len;
-		struct stat st;
+		char path[LINE_SIZE];
 
-		snprintf(path, sizeof(path), "%s/%s", rcsd, name);
+		snprintf(path, sizeof(path), "%s/%s", rcsd, e[i]->d_name);
+		if (is_conf(path))
+			parse_conf_dynamic(path);
+		else
+			cache_key(path); /* E.g. dangling symlink */
+	}
 
-		/* Check that it's an actual file ... beyond any symlinks */
-		if (lstat(path, &st)) {
-			_d("Skipping %s, cannot access: %s", path, strerror(errno));
-			continue;
-		}
+	while (num--)
+		free(e[num]);
+	free(e);
+done:
+	cache_save();
+}
 
-		/* Skip directories */
-		if (S_ISDIR(st.st_mode)) {
-			_d("Skipping directory %s", path);
-			continue;
-		}
+/*
+ * Reparse only the *.conf in /etc/finit.d/ that have changed since the
+ * last reload.  Services and TTYs declared in them are marked, and are
+ * removed unless they are declared again, e.g. when a file is removed.
+ */
+static void reload_changed(void)
+{
+	struct conf_change *node;
 
-		/* Check for dangling symlinks */
-		if (S_ISLNK(st.st_mode)) {
-			char *rp;
+	svc_mark_changed();
+	tty_mark_changed();
 
-			rp = realpath(path, NULL);
-			if (!rp) {
-				logit(LOG_WARNING, "Skipping %s, dangling symlink: %s", path, strerror(errno));
-				continue;
-			}
+	TAILQ_FOREACH(node, &conf_change_list, link) {
+		char path[LINE_SIZE];
 
-			free(rp);
-		}
+		snprintf(path, sizeof(path), "%s/%s", rcsd, node->name);
+		if (is_conf(path))
+			parse_conf_dynamic(path);
+	}
+}
 
-		/* Check that file ends with '.conf' */
-		len = strlen(path);
-		if (len < 6 || strcmp(&path[len - 5], ".conf")) {
-			_d("Skipping %s, not a valid .conf ... ", path);
-			continue;
+/*
+ * Can we trust the list of changes?  We need to be monitoring both
+ * /etc/finit.conf and /etc/finit.d/, and changes to finit.conf, e.g.
+ * global rlimits and include files, affect everything.
+ */
+static int is_incremental(void)
+{
+	char *conf;
+
+	if (wd_rcsd < 0 || conf_overflow)
+		return 0;
+	if (wd_conf < 0 && fexist(FINIT_CONF))
+		return 0;
+
+	conf = strrchr(FINIT_CONF, '/');
+	if (conf_find(conf ? conf + 1 : FINIT_CONF))
+		return 0;
+
+	return 1;
+}
+
+static int reload(int full)
+{
+	if (rescue) {
+		int rc;
+		char line[80] = "tty [12345] @console noclear nologin";
+
+		/* Mark and sweep */
+		svc_mark_dynamic();
+		tty_mark();
+
+		/* If rescue.conf is missing, fall back to a root shell */
+		rc = parse_conf(RESCUE_CONF);
+		if (rc)
+			tty_register(line, global_rlimit, NULL);
+
+		print(rc, "Entering rescue mode");
+	} else if (full || !is_incremental()) {
+		reload_all();
+	} else {
+		if (TAILQ_EMPTY(&conf_change_list)) {
+			_d("No .conf changes, skipping reload.");
+			return 0;
 		}
 
-		parse_conf_dynamic(path);
+		reload_changed();
 	}
 
-	while (num--)
-		free(e[num]);
-	free(e);
-
-done:
 	/* Drop record of all .conf changes */
 	drop_changes();
+	conf_overflow = 0;
 
 	/* Override configured runlevel, user said 'S' on /proc/cmdline */
 	if (BOOTSTRAP && single)
@@ -671,11 +884,30 @@ done:
 	return 0;
 }
 
+/*
+ * Reload changed .conf files, or everything if we cannot tell what
+ * has changed, or if /etc/finit.conf has changed.
+ */
+int conf_reload(void)
+{
+	return reload(0);
+}
+
+static unsigned int conf_hash(char *name)
+{
+	unsigned int hash = 5381;
+
+	while (*name)
+		hash = hash * 33 + (unsigned char)*name++;
+
+	return hash % CONF_HASH_SIZE;
+}
+
 static struct conf_change *conf_find(char *file)
 {
-	struct conf_change *node, *tmp;
+	struct conf_change *node;
 
-	TAILQ_FOREACH_SAFE(node, &conf_change_list, link, tmp) {
+	LIST_FOREACH(node, &conf_change_hash[conf_hash(file)], hlink) {
 		if (string_compare(node->name, file))
 			return node;
 	}
@@ -689,7 +921,7 @@ static void drop_change(struct conf_change *node)
 		return;
 
 	TAILQ_REMOVE(&conf_change_list, node, link);
-	free(node->name);
+	LIST_REMOVE(node, hlink);
 	free(node);
 }
 
@@ -705,36 +937,32 @@ static void drop_changes(void)
 static int do_change(char *name, uint32_t mask)
 {
 	struct conf_change *node;
+	size_t len;
 
-	node = conf_find(name);
-	if (mask & (IN_DELETE | IN_MOVED_FROM)) {
-		drop_change(node);
+	/* Only files matter, e.g. not the available/ sub-directory */
+	if (mask & IN_ISDIR)
 		return 0;
-	}
 
-	if (node) {
-		_d("Event already registered for %s ...", name);
+	/* Removed files are changes too, their services must be stopped */
+	node = conf_find(name);
+	if (node)
 		return 0;
-	}
 
-	node = malloc(sizeof(*node));
+	len = strlen(name) + 1;
+	node = malloc(sizeof(*node) + len);
 	if (!node)
 		return 1;
+	memcpy(node->name, name, len);
 
-	node->name = strdup(name);
-	if (!node->name) {
-		free(node);
-		return 1;
-	}
-
-	TAILQ_INSERT_HEAD(&conf_change_list, node,link);
+	TAILQ_INSERT_TAIL(&conf_change_list, node, link);
+	LIST_INSERT_HEAD(&conf_change_hash[conf_hash(name)], node, hlink);
 
 	return 0;
 }
 
 int conf_any_change(void)
 {
-	if (TAILQ_EMPTY(&conf_change_list))
+	if (TAILQ_EMPTY(&conf_change_list) && !conf_overflow)
 		return 0;
 
 	return 1;
@@ -756,86 +984,125 @@ int conf_changed(char *file)
 	return 0;
 }
 
-static void conf_cb(uev_t *w, void *arg, int events)
+static void reload_cb(uev_t *w, void *arg, int events)
 {
-	static char ev_buf[8 *(sizeof(struct inotify_event) + NAME_MAX + 1) + 1];
-	struct inotify_event *ev;
-	ssize_t sz, len;
+	uev_timer_stop(w);
+	reload_timer_armed = 0;
 
-	sz = read(w->fd, ev_buf, sizeof(ev_buf) - 1);
-	if (sz <= 0) {
-		_pe("invalid inotify event");
+	if (!conf_any_change())
 		return;
-	}
-	ev_buf[sz] = 0;
-	ev = (struct inotify_event *)ev_buf;
 
-	if (arg) {
-		do_change(arg, ev->mask);
+	_d("Configuration changes have settled, reloading ...");
+	service_reload_dynamic();
+}
+
+/* (Re)start the autoreload timer, i.e., wait for changes to settle */
+static void reload_later(void)
+{
+	if (!autoreload || !conf_ctx)
+		return;
+
+	if (reload_timer_armed) {
+		uev_timer_set(&reload_timer, autoreload, 0);
 		return;
 	}
 
-	for (ev = (void *)ev_buf; sz > (ssize_t)sizeof(*ev);
-	     len = sizeof(*ev) + ev->len, ev = (void *)ev + len, sz -= len) {
-		if (do_change(ev->name, ev->mask)) {
-			_pe("conf_monitor: Out of memory");
-			break;
-		}
+	if (uev_timer_init(conf_ctx, &reload_timer, reload_cb, NULL, autoreload, 0)) {
+		_pe("Failed starting autoreload timer");
+		return;
 	}
+	reload_timer_armed = 1;
 }
 
-static int add_watcher(uev_ctx_t *ctx, uev_t *w, char *path, uint32_t opt)
+static int add_watch(int *wd, char *path, uint32_t opt)
 {
-	struct stat st;
 	uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVE;
-	char *arg = NULL;
-	int fd, wd;
-
-	if (!ctx)
-		return 0;
+	struct stat st;
 
 	if (stat(path, &st)) {
 		_d("No such file or directory, skipping %s", path);
-		w->fd = -1;
+		*wd = -1;
 		return 0;
 	}
-	if (!S_ISDIR(st.st_mode)) {
-		arg = strrchr(path, '/');
-		if (!arg)
-			arg = path;
-		else
-			arg++;
-	}
-
-	if (w->fd >= 0)
-		close(w->fd);
-
-	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
-	if (fd < 0) {
-		_pe("Failed creating inotify descriptor");
-		w->fd = -1;
-		return 1;
-	}
 
 	/*
 	 * Only forward error, don't report error,
 	 * user may not have @path and that's OK
 	 */
-	wd = inotify_add_watch(fd, path, mask | opt);
-	if (wd < 0) {
-		w->fd = -1;
-		close(fd);
+	*wd = inotify_add_watch(conf_watcher.fd, path, mask | opt);
+	if (*wd < 0)
 		return 1;
-	}
 
-	if (uev_io_init(ctx, w, conf_cb, arg, fd, UEV_READ)) {
-		_pe("Failed setting up I/O callback for %s watcher", path);
-		w->fd = -1;
-		close(fd);
-		return 1;
+	return 0;
+}
+
+/*
+ * Drain all pending events and record the changed files.  Changes to
+ * finit.conf are reported without a name, since it is a file watch.
+ */
+static void conf_cb(uev_t *w, void *arg, int events)
+{
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	uint64_t t0 = prof_now();
+	int num = 0, rewatch = 0;
+	ssize_t len;
+	char *conf;
+
+	conf = strrchr(FINIT_CONF, '/');
+	conf = conf ? conf + 1 : FINIT_CONF;
+
+	while ((len = read(w->fd, buf, sizeof(buf))) > 0) {
+		char *ptr;
+
+		for (ptr = buf; ptr < buf + len; ptr += sizeof(*ev) + ev->len) {
+			char *name = NULL;
+
+			ev = (struct inotify_event *)ptr;
+			if (ev->mask & IN_Q_OVERFLOW) {
+				_d("Lost inotify events, reloading all .conf files.");
+				conf_overflow = 1;
+				num++;
+				continue;
+			}
+
+			if (ev->wd == wd_conf) {
+				name = conf;
+				/* Replaced, e.g. by an editor, watch the new file */
+				if (ev->mask & IN_IGNORED) {
+					wd_conf = -1;
+					rewatch = 1;
+				}
+			} else if (ev->mask & IN_IGNORED) {
+				if (ev->wd == wd_rcsd)
+					wd_rcsd = -1;
+				if (ev->wd == wd_avail)
+					wd_avail = -1;
+			} else if (ev->len) {
+				name = ev->name;
+			}
+
+			if (!name)
+				continue;
+
+			if (do_change(name, ev->mask)) {
+				_pe("conf_monitor: Out of memory");
+				conf_overflow = 1;
+			}
+			num++;
+		}
 	}
 
-	return 0;
+	if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+		_pe("Failed reading inotify events");
+
+	if (rewatch)
+		add_watch(&wd_conf, FINIT_CONF, 0);
+
+	if (num)
+		reload_later();
+
+	prof_add("conf", NULL, t0);
 }
 
 /*
@@ -843,23 +1110,39 @@ static int add_watcher(uev_ctx_t *ctx, uev_t *w, char *path, uint32_t opt)
  */
 int conf_monitor(uev_ctx_t *ctx)
 {
-	int rc = 0;
+	int fd, rc = 0;
 
 	/* Skip second run, when called from finit.c in rescue mode */
 	if (ctx && rescue)
 		return 0;
 
-	/*
-	 * If only one watcher fails, that's OK.  A user may have only
-	 * one of /etc/finit.conf or /etc/finit.d in use, and may also
-	 * have or not have symlinks in place.  We need to monitor for
-	 * changes to either symlink or target.
-	 */
-	rc += add_watcher(ctx, &w1, FINIT_RCSD, 0);
-	rc += add_watcher(ctx, &w2, FINIT_RCSD "/available", IN_DONT_FOLLOW);
-	rc += add_watcher(ctx, &w3, FINIT_CONF, 0);
+	if (ctx && conf_watcher.fd < 0) {
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0) {
+			_pe("Failed creating inotify descriptor");
+			goto done;
+		}
 
-	return rc + conf_reload();
+		if (uev_io_init(ctx, &conf_watcher, conf_cb, NULL, fd, UEV_READ)) {
+			_pe("Failed setting up I/O callback for .conf watcher");
+			conf_watcher.fd = -1;
+			close(fd);
+			goto done;
+		}
+		conf_ctx = ctx;
+
+		/*
+		 * If only one watch fails, that's OK.  A user may have only
+		 * one of /etc/finit.conf or /etc/finit.d in use, and may also
+		 * have or not have symlinks in place.  We need to monitor for
+		 * changes to either symlink or target.
+		 */
+		rc += add_watch(&wd_rcsd,  FINIT_RCSD, 0);
+		rc += add_watch(&wd_avail, FINIT_RCSD "/available", IN_DONT_FOLLOW);
+		rc += add_watch(&wd_conf,  FINIT_CONF, 0);
+	}
+done:
+	return rc + reload(1);
 }
 
 /*
@@ -868,7 +1151,7 @@ int conf_monitor(uev_ctx_t *ctx)
 int conf_init(void)
 {
 	hostname = strdup(DEFHOST);
-	w1.fd = w2.fd = w3.fd = -1;
+	conf_watcher.fd = -1;
 
 	return conf_monitor(NULL);
 }
@@ -42,7 +42,7 @@ int  conf_monitor         (uev_ctx_t *ctx);
 
 void conf_parse_cmdline   (void);
 int  conf_parse_runlevels (char *runlevels);
-void conf_parse_cond      (svc_t *svc, char *cond);
+void conf_parse_cond      (svc_t *svc, svc_conf_buf_t *buf, char *cond);
 
 #endif	/* FINIT_CONF_H_ */
 
@@ -37,6 +37,7 @@
 #include "finit.h"
 #include "conf.h"
 #include "helpers.h"
+#include "pidfd.h"
 #include "sig.h"
 #include "utmp-api.h"
 
@@ -354,84 +355,131 @@ static int activate_console(int noclear, int nowait)
  * When handing over to /bin/login, Ctrl-C and Ctrl-D must be enabled
  * since /bin/login usually only disables ECHO until a password line has
  * been entered.  Upon starting the user's $SHELL the ISIG flag is reset
+ *
+ * Called in the child process forked by tty_start(), never returns.
  */
-pid_t run_getty(char *tty, char *baud, char *term, int noclear, int nowait, struct rlimit rlimit[])
+void exec_getty(char *tty, char *baud, char *term, int noclear, int nowait, struct rlimit rlimit[])
 {
-	pid_t pid;
-
-	pid = fork();
-	if (!pid) {
-		speed_t speed = B38400;
-
-		if (baud) {
-			speed = stty_parse_speed(baud);
-			if (B0 == speed)
-				logit(LOG_CRIT, "TTY %s: Invalid speed %s", tty, baud);
-		}
+	speed_t speed = B38400;
 
-		prepare_tty(tty, speed, "finit-getty", rlimit);
-		if (activate_console(noclear, nowait))
-			_exit(getty(tty, speed, term, NULL));
+	if (baud) {
+		speed = stty_parse_speed(baud);
+		if (B0 == speed)
+			logit(LOG_CRIT, "TTY %s: Invalid speed %s", tty, baud);
 	}
 
-	return pid;
+	prepare_tty(tty, speed, "finit-getty", rlimit);
+	if (activate_console(noclear, nowait))
+		_exit(getty(tty, speed, term, NULL));
+
+	_exit(0);
 }
 
-pid_t run_getty2(char *tty, char *cmd, char *args[], int noclear, int nowait, struct rlimit rlimit[])
+void exec_getty2(char *tty, char *cmd, char *args[], int noclear, int nowait, struct rlimit rlimit[])
 {
-	pid_t pid;
+	int  i, fd;
+	struct sigaction sa;
 
-	pid = fork();
-	if (!pid) {
-		int  i, fd;
-		struct sigaction sa;
+	/* Reset signal handlers that were set by the parent process */
+	for (i = 1; i < NSIG; i++)
+		DFLSIG(sa, i, 0);
 
-		/* Reset signal handlers that were set by the parent process */
-		for (i = 1; i < NSIG; i++)
-			DFLSIG(sa, i, 0);
+	/* Detach from initial controlling TTY */
+	vhangup();
 
-		/* Detach from initial controlling TTY */
-		vhangup();
+	close(STDERR_FILENO);
+	close(STDOUT_FILENO);
+	close(STDIN_FILENO);
 
-		close(STDERR_FILENO);
-		close(STDOUT_FILENO);
-		close(STDIN_FILENO);
+	/* Attach TTY to console */
+	fd = open(tty, O_RDWR);
+	if (fd != STDIN_FILENO)
+		exit(1);
 
-		/* Attach TTY to console */
-		fd = open(tty, O_RDWR);
-		if (fd != STDIN_FILENO)
-			exit(1);
+	dup2(fd, STDIN_FILENO);
+	dup2(fd, STDOUT_FILENO);
+	dup2(fd, STDERR_FILENO);
 
-		dup2(fd, STDIN_FILENO);
-		dup2(fd, STDOUT_FILENO);
-		dup2(fd, STDERR_FILENO);
+	/* Dunno speed, tell stty() to not mess with it */
+	prepare_tty(tty, B0, "getty", rlimit);
 
-		/* Dunno speed, tell stty() to not mess with it */
-		prepare_tty(tty, B0, "getty", rlimit);
+	if (ioctl(STDIN_FILENO, TIOCSCTTY, 1) < 0)
+		_pe("Failed TIOCSCTTY");
 
-		if (ioctl(STDIN_FILENO, TIOCSCTTY, 1) < 0)
-			_pe("Failed TIOCSCTTY");
+	if (activate_console(noclear, nowait))
+		_exit(execv(cmd, args));
 
-		if (activate_console(noclear, nowait))
-			_exit(execv(cmd, args));
+	close(fd);
+	vhangup();
+	exit(0);
+}
 
-		close(fd);
-		vhangup();
-		exit(0);
-	}
+void exec_sh(char *tty, int noclear, int nowait, struct rlimit rlimit[])
+{
+	prepare_tty(tty, B0, "finit-sh", rlimit);
+	if (activate_console(noclear, nowait))
+		_exit(sh(tty));
 
-	return pid;
+	_exit(0);
 }
 
-pid_t run_sh(char *tty, int noclear, int nowait, struct rlimit rlimit[])
+/*
+ * Start one script in a run-parts directory, S<NUM>service and
+ * K<NUM>service scripts are called with 'start' and 'stop' unless the
+ * caller supplied a @cmd.  With a @w the child is forked with
+ * pidfd_fork(), otherwise with plain fork().
+ *
+ * Returns PID of child, or zero if @name is not an executable.
+ */
+static pid_t run_part(char *dir, char *name, char *cmd, uev_t *w, uev_cb_t *cb, void *arg)
 {
-	pid_t pid;
+	int j = 0;
+	pid_t pid = 0;
+	struct stat st;
+	char *args[NUM_ARGS];
+	char path[LINE_SIZE];
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	if (stat(path, &st)) {
+		_d("Failed stat(%s): %s", path, strerror(errno));
+		return 0;
+	}
 
-	pid = fork();
+	if (!S_ISEXEC(st.st_mode) || S_ISDIR(st.st_mode)) {
+		_d("Skipping %s ...", path);
+		return 0;
+	}
+
+	/* Fill in args[], starting with full path to executable */
+	args[j++] = path;
+
+	/* If the callee didn't supply a run_parts() argument */
+	if (!cmd) {
+		/* Check if S<NUM>service or K<NUM>service notation is used */
+		_d("Checking if %s is a sysvinit startstop script ...", name);
+		if (name[0] == 'S' && isdigit(name[1])) {
+			args[j++] = "start";
+		} else if (name[0] == 'K' && isdigit(name[1])) {
+			args[j++] = "stop";
+		}
+	} else {
+		args[j++] = cmd;
+	}
+	args[j++] = NULL;
+
+	if (w)
+		pid = pidfd_fork(w, cb, arg);
+	else
+		pid = fork();
 	if (!pid) {
-		prepare_tty(tty, B0, "finit-sh", rlimit);
-		if (activate_console(noclear, nowait))
-			_exit(sh(tty));
+		_d("Calling %s ...", path);
+		sig_unblock();
+		execv(path, args);
+		exit(0);
+	}
+	if (pid < 0) {
+		_pe("Failed starting %s", path);
+		return 0;
 	}
 
 	return pid;
@@ -449,55 +497,230 @@ int run_parts(char *dir, char *cmd)
 	}
 
 	for (i = 0; i < num; i++) {
-		int j = 0;
-		pid_t pid = 0;
-		struct stat st;
-		char *args[NUM_ARGS];
-		char *name = e[i]->d_name;
 		char path[LINE_SIZE];
+		pid_t pid;
 
-		snprintf(path, sizeof(path), "%s/%s", dir, name);
-		if (stat(path, &st)) {
-			_d("Failed stat(%s): %s", path, strerror(errno));
+		pid = run_part(dir, e[i]->d_name, cmd, NULL, NULL, NULL);
+		if (!pid)
 			continue;
-		}
 
-		if (!S_ISEXEC(st.st_mode) || S_ISDIR(st.st_mode)) {
-			_d("Skipping %s ...", path);
+		snprintf(path, sizeof(path), "%s/%s", dir, e[i]->d_name);
+		complete(path, pid);
+	}
+
+	while (num--)
+		free(e[num]);
+	free(e);
+
+	return 0;
+}
+
+/*
+ * State of the one run_parts_parallel() in progress.  Scripts are
+ * started in batches, a batch is all S<NUM> (or K<NUM>) scripts with
+ * the same NUM, e.g. S10foo and S10bar.  Scripts without a sequence
+ * number are a batch of their own.
+ */
+typedef struct {
+	uev_t    watcher;
+	pid_t    pid;
+	char    *name;
+} rp_job_t;
+
+static struct {
+	struct dirent **e;
+	int       num;		/* Number of entries in e[] */
+	int       next;		/* Next entry to start */
+	int       batch;	/* First entry of current batch */
+
+	char     *dir;
+	char     *cmd;
+
+	rp_job_t *job;
+	int       jobs;		/* Max number of concurrent scripts */
+	int       running;
+
+	void    (*done)(void);
+} rp;
+
+/* Length of S<NUM> or K<NUM> prefix of @name, zero if none */
+static size_t batch_key(const char *name)
+{
+	size_t len = 1;
+
+	if ((name[0] != 'S' && name[0] != 'K') || !isdigit(name[1]))
+		return 0;
+
+	while (isdigit(name[len]))
+		len++;
+
+	return len;
+}
+
+static int same_batch(const char *a, const char *b)
+{
+	size_t len = batch_key(a);
+
+	return len && len == batch_key(b) && !strncmp(a, b, len);
+}
+
+static void rp_step(void);
+
+static void rp_collect(rp_job_t *job, int status)
+{
+	if (WIFEXITED(status) && WEXITSTATUS(status))
+		_d("%s/%s exited with status %d", rp.dir, job->name, WEXITSTATUS(status));
+	else if (WIFSIGNALED(status))
+		_d("%s/%s killed by signal %d", rp.dir, job->name, WTERMSIG(status));
+
+	job->pid = 0;
+	rp.running--;
+	rp_step();
+}
+
+static void rp_exit_cb(uev_t *w, void *arg, int events)
+{
+	rp_job_t *job = (rp_job_t *)arg;
+	int status = 0;
+
+	if (pidfd_wait(w, job->pid, &status, WNOHANG) <= 0)
+		return;
+
+	rp_collect(job, status);
+}
+
+static rp_job_t *rp_slot(void)
+{
+	int i;
+
+	for (i = 0; i < rp.jobs; i++) {
+		if (!rp.job[i].pid)
+			return &rp.job[i];
+	}
+
+	return NULL;
+}
+
+/* Start as many scripts of the current batch as allowed, or call done() */
+static void rp_step(void)
+{
+	void (*done)(void);
+
+	while (rp.next < rp.num && rp.running < rp.jobs) {
+		char *name = rp.e[rp.next]->d_name;
+		rp_job_t *job;
+		pid_t pid;
+
+		/* Next batch cannot start until all of this one have completed */
+		if (rp.running && !same_batch(rp.e[rp.batch]->d_name, name))
+			return;
+		if (!rp.running)
+			rp.batch = rp.next;
+
+		job = rp_slot();
+		pid = run_part(rp.dir, name, rp.cmd, &job->watcher, rp_exit_cb, job);
+		rp.next++;
+		if (!pid)
 			continue;
-		}
 
-		/* Fill in args[], starting with full path to executable */
-		args[j++] = path;
-
-		/* If the callee didn't supply a run_parts() argument */
-		if (!cmd) {
-			/* Check if S<NUM>service or K<NUM>service notation is used */
-			_d("Checking if %s is a sysvinit startstop script ...", name);
-			if (name[0] == 'S' && isdigit(name[1])) {
-				args[j++] = "start";
-			} else if (name[0] == 'K' && isdigit(name[1])) {
-				args[j++] = "stop";
-			}
-		} else {
-			args[j++] = cmd;
-		}
-		args[j++] = NULL;
+		job->pid  = pid;
+		job->name = name;
+		rp.running++;
+	}
 
-		pid = fork();
-		if (!pid) {
-			_d("Calling %s ...", path);
-			sig_unblock();
-			execv(path, args);
-			exit(0);
-		}
+	if (rp.running || rp.next < rp.num)
+		return;
+
+	_d("All scripts in %s done.", rp.dir);
+	while (rp.num--)
+		free(rp.e[rp.num]);
+	free(rp.e);
+	free(rp.job);
+	free(rp.dir);
+	free(rp.cmd);
+
+	done = rp.done;
+	memset(&rp, 0, sizeof(rp));
+	if (done)
+		done();
+}
+
+/**
+ * run_parts_parallel - Run scripts in a directory, without blocking
+ * @dir:  Directory with scripts, same as run_parts()
+ * @cmd:  Optional argument to scripts, same as run_parts()
+ * @jobs: Max number of scripts to run concurrently
+ * @done: Called when all scripts have completed, may be %NULL
+ *
+ * Like run_parts(), but the scripts are collected by the event loop.
+ * All S<NUM>/K<NUM> scripts with the same NUM are started at the same
+ * time, at most @jobs of them, and the next batch is started when all
+ * scripts in the current batch have completed.  Only one run can be in
+ * progress at any given time.
+ *
+ * Returns:
+ * POSIX OK(0) if @done will be called, otherwise non-zero.
+ */
+int run_parts_parallel(char *dir, char *cmd, int jobs, void (*done)(void))
+{
+	if (rp.e)
+		return errno = EBUSY;
+
+	if (jobs < 1)
+		jobs = 1;
+
+	rp.job = calloc(jobs, sizeof(rp_job_t));
+	if (!rp.job)
+		return errno = ENOMEM;
+
+	/* Our own copies, a reload may free the runparts setting meanwhile */
+	rp.dir = strdup(dir);
+	rp.cmd = cmd ? strdup(cmd) : NULL;
+	if (!rp.dir || (cmd && !rp.cmd))
+		goto fail;
 
-                complete(path, pid);
+	rp.num = scandir(dir, &rp.e, NULL, alphasort);
+	if (rp.num < 0) {
+		_d("No files found in %s, skipping ...", dir);
+		goto fail;
 	}
 
-	while (num--)
-		free(e[num]);
-	free(e);
+	_d("Running scripts in %s, max %d at a time ...", dir, jobs);
+	rp.jobs = jobs;
+	rp.done = done;
+	rp_step();
+
+	return 0;
+fail:
+	free(rp.job);
+	free(rp.dir);
+	free(rp.cmd);
+	memset(&rp, 0, sizeof(rp));
+
+	return -1;
+}
+
+/**
+ * run_parts_lost - Collect run_parts_parallel() script on older kernels
+ * @pid:    PID of collected process
+ * @status: Exit status from waitpid()
+ *
+ * Without pidfd support all children are collected by the SIGCHLD
+ * handler, which calls service_monitor() and in turn this function.
+ *
+ * Returns:
+ * %TRUE(1) if @pid was a run-parts script, otherwise %FALSE(0).
+ */
+int run_parts_lost(pid_t pid, int status)
+{
+	int i;
+
+	for (i = 0; i < rp.jobs; i++) {
+		if (rp.job[i].pid == pid) {
+			rp_collect(&rp.job[i], status);
+			return 1;
+		}
+	}
 
 	return 0;
 }
@@ -36,11 +36,13 @@
 #include <lite/lite.h>
 
 #include "finit.h"
+#include "cgroup.h"
 #include "cond.h"
 #include "conf.h"
 #include "helpers.h"
 #include "private.h"
 #include "plugin.h"
+#include "prof.h"
 #include "service.h"
 #include "sig.h"
 #include "sm.h"
@@ -61,6 +63,7 @@ char *network   = NULL;
 char *hostname  = NULL;
 char *rcsd      = FINIT_RCSD;
 char *runparts  = NULL;
+int   runparts_jobs = 1;
 
 uev_ctx_t *ctx  = NULL;		/* Main loop context */
 
@@ -202,27 +205,13 @@ static void emergency_shell(void)
 }
 
 /*
- * Handle bootstrap transition to configured runlevel, start TTYs
- *
- * This is the final stage of bootstrap.  It changes to the default
- * (configured) runlevel, calls all external start scripts and final
- * bootstrap hooks before bringing up TTYs.
- *
- * We must ensure that all declared `task [S]` and `run [S]` jobs in
- * finit.conf, or *.conf in finit.d/, run to completion before we
- * finalize the bootstrap process by calling this function.
+ * Second half of finalize(), called when all startup scripts in the
+ * runparts directory have completed.
  */
-static void finalize(void)
+static void finalize_services(void)
 {
-	/*
-	 * Run startup scripts in the runparts directory, if any.
-	 */
-	if (runparts && fisdir(runparts) && !rescue) {
-		_d("Running startup scripts in %s ...", runparts);
-		run_parts(runparts, NULL);
-		if (conf_any_change())
-			service_reload_dynamic();
-	}
+	if (conf_any_change())
+		service_reload_dynamic();
 
 	/*
 	 * Start all tasks/services in the configured runlevel
@@ -260,6 +249,33 @@ static void finalize(void)
 	tty_runlevel();
 }
 
+/*
+ * Handle bootstrap transition to configured runlevel, start TTYs
+ *
+ * This is the final stage of bootstrap.  It changes to the default
+ * (configured) runlevel, calls all external start scripts and final
+ * bootstrap hooks before bringing up TTYs.
+ *
+ * We must ensure that all declared `task [S]` and `run [S]` jobs in
+ * finit.conf, or *.conf in finit.d/, run to completion before we
+ * finalize the bootstrap process by calling this function.
+ */
+static void finalize(void)
+{
+	/*
+	 * Run startup scripts in the runparts directory, if any.  The
+	 * event loop keeps running while the scripts run, the rest of
+	 * the bootstrap is done by finalize_services() afterwards.
+	 */
+	if (runparts && fisdir(runparts) && !rescue) {
+		_d("Running startup scripts in %s ...", runparts);
+		if (!run_parts_parallel(runparts, NULL, runparts_jobs, finalize_services))
+			return;
+	}
+
+	finalize_services();
+}
+
 int main(int argc, char* argv[])
 {
 	char *path;
@@ -295,6 +311,7 @@ int main(int argc, char* argv[])
 	mount("none", "/sys", "sysfs", 0, NULL);
 	if (fisdir("/proc/bus/usb"))
 		mount("none", "/proc/bus/usb", "usbfs", 0, NULL);
+	cgroup_init();
 
 	/*
 	 * Parse kernel command line (debug, rescue, splash, etc.)
@@ -426,7 +443,7 @@ int main(int argc, char* argv[])
 	 */
 	if (!rescue) {
 #ifdef REMOUNT_ROOTFS
-		run("mount -n -o remount,rw /");
+		remount_root(0);
 #endif
 #ifdef SYSROOT
 		mount(SYSROOT, "/", NULL, MS_MOVE, NULL);
@@ -445,13 +462,14 @@ int main(int argc, char* argv[])
 		plugin_run_hooks(HOOK_ROOTFS_UP);
 
 		umask(0);
-		if (run_interactive("mount -na", "Mounting filesystems"))
+		print_desc(NULL, "Mounting filesystems");
+		if (print_result(mount_all()))
 			plugin_run_hooks(HOOK_MOUNT_ERROR);
 
 		_d("Calling extra mount hook, after mount -a ...");
 		plugin_run_hooks(HOOK_MOUNT_POST);
 
-		run("swapon -ea");
+		swap_on();
 		umask(0022);
 	}
 
@@ -480,6 +498,9 @@ int main(int argc, char* argv[])
 	api_init(&loop);
 	umask(022);
 
+	/* Measure event loop latency, see initctl debug-stats */
+	prof_init(&loop);
+
 	/*
 	 * Wait for all SVC_TYPE_RUNTASK to have completed their work in
 	 * [S], or timeout, before calling finalize()
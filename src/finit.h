@@ -81,6 +81,9 @@
 #define INIT_CMD_SVC_ITER       129
 #define INIT_CMD_SVC_QUERY      130
 #define INIT_CMD_SVC_FIND       131
+#define INIT_CMD_SVC_CGROUP     132  /* Resource usage, see cgroup.h */
+#define INIT_CMD_SVC_STATS      133  /* Runtime statistics, see svc.h */
+#define INIT_CMD_DEBUG_STATS    134  /* Event loop handler stats, see prof.h */
 #define INIT_CMD_NACK           254
 #define INIT_CMD_ACK            255
 
@@ -104,6 +107,7 @@ extern char  *sdown;
 extern char  *network;
 extern char  *hostname;
 extern char  *runparts;
+extern int    runparts_jobs;
 extern uev_ctx_t *ctx;
 
 #endif /* FINIT_H_ */
@@ -71,10 +71,19 @@ int     complete        (char *cmd, int pid);
 int     run             (char *cmd);
 int     run_interactive (char *cmd, char *fmt, ...);
 int     exec_runtask    (char *cmd, char *args[]);
-pid_t   run_getty       (char *tty, char *baud, char *term,  int noclear, int nowait, struct rlimit rlimit[]);
-pid_t   run_getty2      (char *tty, char *cmd, char *args[], int noclear, int nowait, struct rlimit rlimit[]);
-pid_t   run_sh          (char *tty, int noclear, int nowait, struct rlimit rlimit[]);
+void    exec_getty      (char *tty, char *baud, char *term,  int noclear, int nowait, struct rlimit rlimit[]);
+void    exec_getty2     (char *tty, char *cmd, char *args[], int noclear, int nowait, struct rlimit rlimit[]);
+void    exec_sh         (char *tty, int noclear, int nowait, struct rlimit rlimit[]);
 int     run_parts       (char *dir, char *cmd);
+int     run_parts_parallel(char *dir, char *cmd, int jobs, void (*done)(void));
+int     run_parts_lost  (pid_t pid, int status);
+
+int     mount_all       (void);
+int     swap_on         (void);
+void    swap_off        (void);
+int     remount_root    (int rdonly);
+void    unmount_tmpfs   (void);
+int     unmount_regular (void);
 
 static inline void create(char *path, mode_t mode, uid_t uid, gid_t gid)
 {
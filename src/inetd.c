@@ -21,10 +21,18 @@
  * THE SOFTWARE.
  */
 
+#include <dirent.h>
 #include <ifaddrs.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <linux/filter.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 #include <sys/socket.h>
+#include <syslog.h>
 #include <uev/uev.h>
 #include <lite/lite.h>
 
@@ -32,7 +40,9 @@
 #include "inetd.h"
 #include "helpers.h"
 #include "private.h"
+#include "prof.h"
 #include "service.h"
+#include "util.h"
 
 #define ENABLE_SOCKOPT(sd, level, opt)						\
 	do {									\
@@ -42,6 +52,19 @@
 			      #opt, inetd->name);				\
 	} while (0);
 
+#define INETD_BACKLOG  128	/* Default listen() backlog */
+#define INETD_BATCH    16	/* Default max accept() per wakeup */
+#define INETD_SHARDS   16	/* Max SO_REUSEPORT sockets per service */
+
+#define FILTER_ACCEPT  0xffffffff
+#define FILTER_DROP    0
+
+static uev_t link_watcher;
+static int   link_watching = 0;
+
+static int filter_attach(inetd_t *inetd, int sd);
+static void filter_refresh(inetd_t *inetd);
+
 /* Peek into SOCK_DGRAM socket to figure out where an inbound packet comes from. */
 static int inetd_dgram_peek(int sd, char *ifname)
 {
@@ -122,28 +145,73 @@ static int inetd_stream_peek(int sd, char *ifname)
 	return 0;
 }
 
-static int get_stdin(svc_t *svc)
+/*
+ * Local clients connecting to the address of, e.g., eth0 arrive on lo.
+ * The socket filter lets lo through, so check those in userspace, by
+ * destination address, like we always have.
+ */
+static int inetd_is_local(int sd, struct in_addr peer)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+
+	if ((ntohl(peer.s_addr) >> 24) == IN_LOOPBACKNET)
+		return 1;
+
+	if (-1 == getsockname(sd, (struct sockaddr *)&sin, &len))
+		return 1;
+
+	return sin.sin_addr.s_addr == peer.s_addr;
+}
+
+/* Call @fn for the service socket watcher and any extra shards */
+static void watchers(inetd_t *inetd, int (*fn)(uev_t *))
 {
-	int stdin = svc->inetd.watcher.fd;
+	fn(&inetd->watcher);
+	for (int i = 0; i < inetd->nshards; i++)
+		fn(&inetd->shard[i]);
+}
+
+static int get_stdin(svc_t *svc, int sd, struct in_addr *peer)
+{
+	int stdin = sd;
 	char ifname[IF_NAMESIZE] = "UNKNOWN";
 
 	if (svc->inetd.type == SOCK_STREAM) {
-		/* Open new client socket from server socket */
-		stdin = accept(stdin, NULL, NULL);
+		struct sockaddr_in sin;
+		socklen_t len = sizeof(sin);
+
+		/*
+		 * Open new client socket from server socket, in blocking
+		 * mode since that's what is expected by inetd services.
+		 */
+		stdin = accept4(sd, (struct sockaddr *)&sin, &len, SOCK_CLOEXEC);
 		if (stdin < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return -EAGAIN;
+
 			logit(LOG_CRIT, "Failed accepting inetd service %d/tcp", svc->inetd.port);
 			return -1;
 		}
+		*peer = sin.sin_addr;
 
 		_d("New client socket %d accepted for inetd service %d/tcp", stdin, svc->inetd.port);
 
+		/* Kernel has already dropped everything not allowed */
+		if (svc->inetd.kfilter && !inetd_is_local(stdin, sin.sin_addr))
+			return stdin;
+
 		inetd_stream_peek(stdin, ifname);
 	} else {           /* SOCK_DGRAM */
+		if (svc->inetd.kfilter)
+			return stdin;
+
 		inetd_dgram_peek(stdin, ifname);
 	}
 
 	if (!inetd_is_allowed(&svc->inetd, ifname)) {
 		logit(LOG_INFO, "Service %s on %s:%d is not allowed", svc->inetd.name, ifname, svc->inetd.port);
+		svc->stats.refused++;
 		if (svc->inetd.type == SOCK_STREAM)
 			close(stdin);
 		else
@@ -155,42 +223,185 @@ static int get_stdin(svc_t *svc)
 	return stdin;
 }
 
-/* Socket callback, looks up correct svc and starts it as an inetd service */
-static void socket_cb(uev_t *w, void *arg, int events)
+static void holdoff_cb(uev_t *w, void *arg, int events)
 {
-	svc_t *svc = (svc_t *)arg, *task;
-	const char *conn = " connection";
-	int stdin;
+	inetd_t *inetd = (inetd_t *)arg;
 
-	_d("%s: Got socket event ...", svc->cmd);
-	if (UEV_ERROR == events) {
-		logit(LOG_INFO, "%s: Socket error, aborting: %m", svc->cmd);
+	inetd->held = 0;
+	if (inetd->watcher.fd != -1) {
+		_d("Resuming rate limited inetd %s ...", inetd->name);
+		watchers(inetd, uev_io_start);
+	}
+}
+
+/*
+ * Stop accepting for a while, pending connections queue up in the
+ * listen backlog (or socket buffer for UDP) meanwhile.  With a @msec
+ * timeout we resume on our own, otherwise inetd_release() does.
+ */
+static void hold(inetd_t *inetd, int msec)
+{
+	watchers(inetd, uev_io_stop);
+
+	if (msec > 0) {
+		if (uev_timer_init(ctx, &inetd->holdoff, holdoff_cb, inetd, msec, 0)) {
+			_e("Failed starting holdoff timer for %s, resuming now.", inetd->name);
+			watchers(inetd, uev_io_start);
+			return;
+		}
+		inetd->held = 2;
+	} else {
+		inetd->held = 1;
+	}
+}
+
+static void unhold(inetd_t *inetd)
+{
+	if (inetd->held == 2)
+		uev_timer_stop(&inetd->holdoff);
+	inetd->held = 0;
+}
+
+/* Check connection limit and token bucket before accepting anything */
+static int throttle(inetd_t *inetd)
+{
+	long now, max;
+
+	if (inetd->max_conn && inetd->num_conn >= inetd->max_conn) {
+		_d("Inetd %s at max %d connections, holding ...", inetd->name, inetd->max_conn);
+		hold(inetd, 0);
+		return 1;
+	}
+
+	if (!inetd->rate)
+		return 0;
+
+	now = now_ms();
+	max = (inetd->burst > 0 ? inetd->burst : inetd->rate) * 1000L;
+	inetd->credit += (now - inetd->stamp) * inetd->rate;
+	if (inetd->credit > max || inetd->credit < 0)
+		inetd->credit = max;
+	inetd->stamp = now;
+
+	if (inetd->credit < 1000) {
+		int msec = (1000 - inetd->credit) / inetd->rate + 1;
+
+		_d("Inetd %s at max rate %d/s, holding %d msec ...", inetd->name, inetd->rate, msec);
+		hold(inetd, msec);
+		return 1;
+	}
+	inetd->credit -= 1000;
+
+	return 0;
+}
+
+static inetd_peer_t *peer_find(inetd_t *inetd, struct in_addr addr)
+{
+	inetd_peer_t *peer;
+
+	LIST_FOREACH(peer, &inetd->peers, link) {
+		if (peer->addr.s_addr == addr.s_addr)
+			return peer;
+	}
+
+	return NULL;
+}
+
+/* Account for one more connection from @addr, unless at max_perip */
+static int peer_get(inetd_t *inetd, struct in_addr addr)
+{
+	inetd_peer_t *peer;
+
+	peer = peer_find(inetd, addr);
+	if (!peer) {
+		peer = calloc(1, sizeof(*peer));
+		if (!peer)
+			return errno = ENOMEM;
+
+		peer->addr = addr;
+		LIST_INSERT_HEAD(&inetd->peers, peer, link);
+	}
+
+	if (peer->count >= inetd->max_perip)
+		return errno = EBUSY;
+	peer->count++;
+
+	return 0;
+}
+
+static void peer_put(inetd_t *inetd, struct in_addr addr)
+{
+	inetd_peer_t *peer;
+
+	peer = peer_find(inetd, addr);
+	if (!peer)
 		return;
+
+	if (--peer->count <= 0) {
+		LIST_REMOVE(peer, link);
+		free(peer);
 	}
+}
+
+static void peer_flush(inetd_t *inetd)
+{
+	inetd_peer_t *peer, *next;
 
-	stdin = get_stdin(svc);
+	LIST_FOREACH_SAFE(peer, &inetd->peers, link, next) {
+		LIST_REMOVE(peer, link);
+		free(peer);
+	}
+}
+
+/*
+ * Accept one connection and start it as an inetd connection service
+ *
+ * Returns: non-zero when no more connections should be accepted now.
+ */
+static int accept_one(svc_t *svc, int sd)
+{
+	struct in_addr peer = { 0 };
+	int counted = 0;
+	svc_t *task;
+	int stdin;
+
+	if (throttle(&svc->inetd))
+		return 1;
+
+	stdin = get_stdin(svc, sd, &peer);
+	if (stdin == -EAGAIN)
+		return 1;
 	if (stdin < 0) {
 		logit(LOG_CRIT, "%s: Unable to accept incoming connection", svc->cmd);
-		return;
+		return 1;
+	}
+
+	/* Reject cheaply, before forking, and don't flood syslog */
+	if (svc->inetd.type == SOCK_STREAM && svc->inetd.max_perip) {
+		if (peer_get(&svc->inetd, peer)) {
+			_d("%s: Too many connections from %s, rejecting.", svc->cmd, inet_ntoa(peer));
+			svc->stats.refused++;
+			close(stdin);
+			return 0;
+		}
+		counted = 1;
 	}
 
 	/*
 	 * Make sure to disable O_NONBLOCK on the descriptor before
 	 * passing it to the inetd service, that's what is expected.
+	 * The server socket is restored in inetd_start() afterwards.
 	 */
-	if (fcntl(stdin, F_SETFL, fcntl(stdin, F_GETFL, 0) & ~O_NONBLOCK) < 0) {
+	if (svc->inetd.type == SOCK_DGRAM &&
+	    fcntl(stdin, F_SETFL, fcntl(stdin, F_GETFL, 0) & ~O_NONBLOCK) < 0) {
 		logit(LOG_CRIT, "Failed disabling non-blocking on %s socket", svc->cmd);
-		if (svc->inetd.type == SOCK_STREAM)
-			close(stdin);
-		return;
+		return 1;
 	}
 
-	task = svc_new(svc->cmd, svc->inetd.next_id++, SVC_TYPE_INETD_CONN);
+	task = svc_new_instance(svc, svc->inetd.next_id++, SVC_TYPE_INETD_CONN);
 	if (!task) {
 		logit(LOG_CRIT, "%s: Unable to allocate service for inetd client", svc->cmd);
-		if (svc->inetd.type == SOCK_STREAM)
-			close(stdin);
-		return;
+		goto fail;
 	}
 
 	if (!svc->inetd.forking) {
@@ -203,22 +414,445 @@ static void socket_cb(uev_t *w, void *arg, int events)
 
 	/*
 	 * Only copy the most relevant parts of inetd, in particular we
-	 * must *not* copy the watcher data to the clone!
+	 * must *not* copy the watcher data to the clone!  The rest of
+	 * the configuration is shared, see svc_new_instance().
 	 */
 	task->inetd.svc  = svc;
 	task->inetd.cmd  = svc->inetd.cmd;
 	task->inetd.type = svc->inetd.type;
-
-	memcpy(task->rlimit,   svc->rlimit,   sizeof(task->rlimit));
-	memcpy(task->cond,     svc->cond,     sizeof(task->cond));
-	memcpy(task->username, svc->username, sizeof(task->username));
-	memcpy(task->group,    svc->group,    sizeof(task->group));
-	memcpy(task->args,     svc->args,     sizeof(task->args));
-	strlcpy(task->desc, svc->desc, sizeof(task->desc) - strlen(conn));
-	strlcat(task->desc, conn, sizeof(task->desc));
+	task->inetd.peer = peer;
+	task->inetd.counted = counted;
+	svc->inetd.num_conn++;
 
 	task->stdin_fd = stdin;
+	svc->stats.accepted++;
 	service_step(task);
+
+	return !svc->inetd.forking;
+fail:
+	if (svc->inetd.type == SOCK_STREAM) {
+		if (counted)
+			peer_put(&svc->inetd, peer);
+		close(stdin);
+	}
+
+	return 1;
+}
+
+/* Socket callback, looks up correct svc and starts it as an inetd service */
+static void socket_cb(uev_t *w, void *arg, int events)
+{
+	svc_t *svc = (svc_t *)arg;
+	uint64_t t0 = prof_now();
+	int num = 1;
+
+	_d("%s: Got socket event ...", svc->cmd);
+	if (UEV_ERROR == events) {
+		logit(LOG_INFO, "%s: Socket error, aborting: %m", svc->cmd);
+		return;
+	}
+
+	/* Drain the backlog, up to a limit to not starve other events */
+	if (svc->inetd.type == SOCK_STREAM && svc->inetd.forking)
+		num = svc->inetd.batch;
+
+	while (num-- > 0) {
+		if (accept_one(svc, w->fd))
+			break;
+	}
+
+	prof_add("inetd", basename(svc->cmd), t0);
+}
+
+/**
+ * inetd_release - Update books of inetd service when a connection ends
+ * @inetd: The inetd of the inetd_conn, not that of the inetd service
+ *
+ * Called when an inetd connection is unregistered.  An inetd service
+ * held back by its connection limit is resumed, as is a 'wait' service.
+ */
+void inetd_release(inetd_t *inetd)
+{
+	svc_t *svc = inetd->svc;
+
+	/* inetd service has been removed already */
+	if (!svc || !svc_is_inetd(svc))
+		return;
+
+	if (svc->inetd.num_conn > 0)
+		svc->inetd.num_conn--;
+	/* Counted or not by the perip: in effect when it was accepted */
+	if (inetd->counted)
+		peer_put(&svc->inetd, inetd->peer);
+
+	if (svc->inetd.held == 1) {
+		svc->inetd.held = 0;
+		if (svc->inetd.watcher.fd != -1)
+			watchers(&svc->inetd, uev_io_start);
+	}
+
+	if (svc_is_busy(svc)) {
+		svc_unblock(svc);
+		service_step(svc);
+	}
+}
+
+/*
+ * Redirect mode: a single helper process, forked by service_start(),
+ * accepts connections and splices them to a backend server.  The data
+ * never passes through userspace, it goes from one socket to the other
+ * via a pipe per direction.
+ */
+typedef struct {
+	inetd_t       *inetd;
+	struct in_addr peer;
+	int            counted;		/* peer counted, see perip: */
+
+	int            fd[2];		/* 0: client, 1: backend */
+	int            ev[2];		/* Current events of watcher */
+	uev_t          w[2];
+
+	int            pipe[2][2];	/* 0: client->backend, 1: backend->client */
+	size_t         pending[2];	/* Bytes in pipe */
+	int            eof[2];		/* 1: EOF on read side, 2: also shut down */
+	int            connected;
+} redir_t;
+
+static inetd_t *redir_self;
+
+static void redir_close(redir_t *r)
+{
+	inetd_t *inetd = r->inetd;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		uev_io_stop(&r->w[i]);
+		close(r->fd[i]);
+		close(r->pipe[i][0]);
+		close(r->pipe[i][1]);
+	}
+
+	if (r->counted)
+		peer_put(inetd, r->peer);
+	free(r);
+
+	inetd->num_conn--;
+	if (inetd->held == 1) {
+		inetd->held = 0;
+		watchers(inetd, uev_io_start);
+	}
+}
+
+/* Move data in one direction, from socket to pipe, then pipe to socket */
+static int redir_pump(redir_t *r, int dir)
+{
+	const int flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+	ssize_t len;
+
+	if (!r->pending[dir] && !r->eof[dir]) {
+		len = splice(r->fd[dir], NULL, r->pipe[dir][1], NULL, 65536, flags);
+		if (len > 0)
+			r->pending[dir] = len;
+		else if (len == 0)
+			r->eof[dir] = 1;
+		else if (errno != EAGAIN)
+			return -1;
+	}
+
+	if (r->pending[dir]) {
+		len = splice(r->pipe[dir][0], NULL, r->fd[!dir], NULL, r->pending[dir], flags);
+		if (len > 0)
+			r->pending[dir] -= len;
+		else if (len < 0 && errno != EAGAIN)
+			return -1;
+	}
+
+	if (r->eof[dir] == 1 && !r->pending[dir]) {
+		shutdown(r->fd[!dir], SHUT_WR);
+		r->eof[dir] = 2;
+	}
+
+	return 0;
+}
+
+/* Read only when the pipe is drained, write only when there is data */
+static void redir_update(redir_t *r)
+{
+	int i, events;
+
+	for (i = 0; i < 2; i++) {
+		events = 0;
+		if (!r->connected) {
+			if (i == 1)
+				events = UEV_WRITE;
+		} else {
+			if (!r->eof[i] && !r->pending[i])
+				events |= UEV_READ;
+			if (r->pending[!i])
+				events |= UEV_WRITE;
+		}
+
+		if (events == r->ev[i])
+			continue;
+
+		r->ev[i] = events;
+		if (events)
+			uev_io_set(&r->w[i], r->fd[i], events);
+		else
+			uev_io_stop(&r->w[i]);
+	}
+}
+
+static void redir_cb(uev_t *w, void *arg, int events)
+{
+	redir_t *r = (redir_t *)arg;
+
+	if (UEV_ERROR == events)
+		goto done;
+
+	if (!r->connected) {
+		socklen_t len = sizeof(int);
+		int err = 0;
+
+		if (getsockopt(r->fd[1], SOL_SOCKET, SO_ERROR, &err, &len) || err) {
+			logit(LOG_WARNING, "%s: failed connecting to backend %s:%d: %s", r->inetd->name,
+			      inet_ntoa(r->inetd->backend.sin_addr), ntohs(r->inetd->backend.sin_port),
+			      strerror(err ? err : errno));
+			goto done;
+		}
+		r->connected = 1;
+	}
+
+	if (redir_pump(r, 0) || redir_pump(r, 1))
+		goto done;
+
+	if (r->eof[0] == 2 && r->eof[1] == 2)
+		goto done;
+
+	redir_update(r);
+	return;
+done:
+	redir_close(r);
+}
+
+static int redir_new(inetd_t *inetd, uev_ctx_t *loop, int sd, struct in_addr peer, int counted)
+{
+	redir_t *r;
+
+	r = calloc(1, sizeof(*r));
+	if (!r) {
+		if (counted)
+			peer_put(inetd, peer);
+		close(sd);
+		return -1;
+	}
+
+	r->inetd = inetd;
+	r->peer  = peer;
+	r->counted = counted;
+	r->fd[0] = sd;
+	r->fd[1] = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	r->pipe[0][0] = r->pipe[0][1] = r->pipe[1][0] = r->pipe[1][1] = -1;
+	inetd->num_conn++;
+
+	if (r->fd[1] < 0 ||
+	    pipe2(r->pipe[0], O_NONBLOCK | O_CLOEXEC) ||
+	    pipe2(r->pipe[1], O_NONBLOCK | O_CLOEXEC))
+		goto fail;
+
+	if (connect(r->fd[1], (struct sockaddr *)&inetd->backend, sizeof(inetd->backend)) &&
+	    errno != EINPROGRESS)
+		goto fail;
+
+	r->ev[0] = UEV_READ;
+	r->ev[1] = UEV_WRITE;
+	if (uev_io_init(loop, &r->w[0], redir_cb, r, r->fd[0], r->ev[0]) ||
+	    uev_io_init(loop, &r->w[1], redir_cb, r, r->fd[1], r->ev[1]))
+		goto fail;
+
+	/* Wait for connect() to complete before reading from client */
+	redir_update(r);
+
+	return 0;
+fail:
+	logit(LOG_WARNING, "%s: failed redirecting connection: %m", inetd->name);
+	redir_close(r);
+
+	return -1;
+}
+
+static void redir_accept_cb(uev_t *w, void *arg, int events)
+{
+	inetd_t *inetd = (inetd_t *)arg;
+	int num = inetd->batch;
+
+	if (UEV_ERROR == events) {
+		logit(LOG_INFO, "%s: Socket error, aborting: %m", inetd->name);
+		return;
+	}
+
+	while (num-- > 0) {
+		char ifname[IF_NAMESIZE] = "UNKNOWN";
+		struct sockaddr_in sin;
+		socklen_t len = sizeof(sin);
+		int counted = 0;
+		int sd;
+
+		if (throttle(inetd))
+			break;
+
+		sd = accept4(w->fd, (struct sockaddr *)&sin, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (sd < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				logit(LOG_CRIT, "Failed accepting inetd service %d/tcp", inetd->port);
+			break;
+		}
+
+		if (!inetd->kfilter || inetd_is_local(sd, sin.sin_addr)) {
+			inetd_stream_peek(sd, ifname);
+			if (!inetd_is_allowed(inetd, ifname)) {
+				logit(LOG_INFO, "Service %s on %s:%d is not allowed", inetd->name, ifname, inetd->port);
+				close(sd);
+				continue;
+			}
+		}
+
+		if (inetd->max_perip) {
+			if (peer_get(inetd, sin.sin_addr)) {
+				_d("%s: Too many connections from %s, rejecting.", inetd->name, inet_ntoa(sin.sin_addr));
+				close(sd);
+				continue;
+			}
+			counted = 1;
+		}
+
+		redir_new(inetd, w->ctx, sd, sin.sin_addr, counted);
+	}
+}
+
+/*
+ * The helper does not exec, so close everything inherited from PID 1,
+ * e.g., the API socket and all other inetd sockets, but our own.
+ */
+static void redir_closefds(inetd_t *inetd)
+{
+	struct dirent *d;
+	DIR *dir;
+
+	/* Closed below anyway, syslog() reconnects on next use */
+	closelog();
+
+	dir = opendir("/proc/self/fd");
+	if (!dir)
+		return;
+
+	while ((d = readdir(dir))) {
+		int i, fd = atoi(d->d_name);
+
+		if (fd <= STDERR_FILENO || fd == dirfd(dir) || fd == inetd->watcher.fd)
+			continue;
+
+		for (i = 0; i < inetd->nshards; i++) {
+			if (fd == inetd->shard[i].fd)
+				break;
+		}
+		if (i < inetd->nshards)
+			continue;
+
+		close(fd);
+	}
+	closedir(dir);
+}
+
+/**
+ * inetd_redir - Main loop of redirect mode helper process
+ * @inetd: Pointer to inetd_t of the redirect service, sockets opened
+ *
+ * Runs in the forked child of the inetd service, never returns unless
+ * the event loop fails.
+ *
+ * Returns:
+ * Non-zero exit status on failure.
+ */
+int inetd_redir(inetd_t *inetd)
+{
+	uev_ctx_t loop;
+	int i, sd;
+
+	/* Peer closing in the middle of a splice() */
+	signal(SIGPIPE, SIG_IGN);
+	redir_closefds(inetd);
+
+	if (uev_init(&loop))
+		return 1;
+
+	/* From now on all watchers and timers are in our own loop */
+	ctx = &loop;
+	redir_self = inetd;
+	link_watching = 0;
+	inetd->held = 0;
+	inetd->num_conn = 0;
+
+	sd = inetd->watcher.fd;
+	if (uev_io_init(ctx, &inetd->watcher, redir_accept_cb, inetd, sd, UEV_READ))
+		return 1;
+
+	for (i = 0; i < inetd->nshards; i++) {
+		sd = inetd->shard[i].fd;
+		if (uev_io_init(ctx, &inetd->shard[i], redir_accept_cb, inetd, sd, UEV_READ))
+			return 1;
+	}
+
+	/* Take over the link watcher for our copy of the socket filters */
+	filter_refresh(inetd);
+
+	return uev_run(ctx, 0);
+}
+
+/**
+ * inetd_set_redir - Set up redirect mode for inetd service
+ * @inetd: Pointer to inetd_t of an inetd service
+ * @addr:  Backend server, ADDR:PORT, e.g. 127.0.0.1:8080
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero errno exit status if @addr is not a
+ * valid backend or the service is not a TCP service.
+ */
+int inetd_set_redir(inetd_t *inetd, char *addr)
+{
+	char buf[INET_ADDRSTRLEN + 6];
+	const char *errstr;
+	char *port;
+	int num;
+
+	if (!inetd || !addr)
+		return errno = EINVAL;
+
+	strlcpy(buf, addr, sizeof(buf));
+	port = strrchr(buf, ':');
+	if (!port)
+		return errno = EINVAL;
+	*port++ = 0;
+
+	num = strtonum(port, 1, UINT16_MAX, &errstr);
+	if (errstr)
+		return errno = EINVAL;
+
+	memset(&inetd->backend, 0, sizeof(inetd->backend));
+	if (inet_pton(AF_INET, buf, &inetd->backend.sin_addr) != 1)
+		return errno = EINVAL;
+
+	if (inetd->type != SOCK_STREAM) {
+		_e("Inetd %s: redirect is only supported for TCP services.", inetd->name);
+		return errno = EINVAL;
+	}
+
+	inetd->backend.sin_family = AF_INET;
+	inetd->backend.sin_port   = htons(num);
+	inetd->forking            = 1;
+	inetd->redir              = 1;
+
+	return 0;
 }
 
 /*
@@ -248,21 +882,163 @@ int inetd_check_loop(struct sockaddr *sa, socklen_t len, char *name)
         return 0;
 }
 
-/* Launch Inet socket for service.
- * TODO: Add filtering ALLOW/DENY per interface.
+/*
+ * Interfaces come and go, and their ifindex along with them, so the
+ * socket filters must be refreshed on every link change.
  */
-static int spawn_socket(inetd_t *inetd)
+static void link_cb(uev_t *w, void *arg, int events)
 {
+	struct nlmsghdr *nh;
+	svc_t *svc, *iter = NULL;
+	char buf[4096];
+	ssize_t len;
+	int changed = 0;
+
+	if (UEV_ERROR == events) {
+		_e("Link watcher error, restarting it ...");
+		uev_io_set(w, w->fd, UEV_READ);
+		return;
+	}
+
+	while ((len = recv(w->fd, buf, sizeof(buf), 0)) > 0) {
+		for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+			if (nh->nlmsg_type == RTM_NEWLINK || nh->nlmsg_type == RTM_DELLINK)
+				changed = 1;
+		}
+	}
+
+	/* Lost messages, assume the worst */
+	if (len < 0 && errno == ENOBUFS)
+		changed = 1;
+
+	if (!changed)
+		return;
+
+	/* In redirect helper, only our own sockets */
+	if (redir_self) {
+		filter_refresh(redir_self);
+		return;
+	}
+
+	for (svc = svc_inetd_iterator(&iter, 1); svc; svc = svc_inetd_iterator(&iter, 0)) {
+		if (svc->inetd.watcher.fd == -1)
+			continue;
+
+		filter_refresh(&svc->inetd);
+	}
+}
+
+static int link_watch(void)
+{
+	struct sockaddr_nl sa;
 	int sd;
-	socklen_t len = sizeof(struct sockaddr);
-	struct sockaddr_in s;
 
-	if (!inetd->type) {
-		logit(LOG_CRIT, "Invalid inetd service %s, skipping ...", inetd->name);
-		return -EINVAL;
+	if (link_watching)
+		return 0;
+
+	sd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (sd < 0)
+		return -1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = RTMGRP_LINK;
+	if (bind(sd, (struct sockaddr *)&sa, sizeof(sa)) ||
+	    uev_io_init(ctx, &link_watcher, link_cb, NULL, sd, UEV_READ)) {
+		close(sd);
+		return -1;
 	}
 
-	_d("Spawning server socket for inetd %s, type %s ...", inetd->name, inetd->type == SOCK_STREAM ? "stream" : "dgram");
+	link_watching = 1;
+
+	return 0;
+}
+
+/*
+ * Translate the ALLOW/DENY interface filters to a classic BPF program
+ * matching on the inbound ifindex, so the kernel drops disallowed SYNs
+ * and datagrams before they ever wake us up.  Interfaces that do not
+ * exist yet cannot be matched, so the userspace checks in get_stdin()
+ * are kept as a fallback until the link watcher has refreshed us.
+ */
+static int filter_attach(inetd_t *inetd, int sd)
+{
+	inetd_filter_t *filter;
+	struct sock_filter *code;
+	struct sock_fprog prog;
+	unsigned int ifindex, lo;
+	size_t i = 0, num = 4;
+	__u32 verdict = FILTER_DROP;
+	int complete = 1;
+
+	inetd->kfilter = 0;
+
+	TAILQ_FOREACH(filter, &inetd->filters, link)
+		num += 2;
+
+	code = calloc(num, sizeof(*code));
+	if (!code)
+		return errno = ENOMEM;
+
+	code[i++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX);
+
+	/* Stream filters match on destination address, lo is checked on accept */
+	lo = if_nametoindex("lo");
+	if (inetd->type == SOCK_STREAM && lo) {
+		code[i++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, lo, 0, 1);
+		code[i++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, FILTER_ACCEPT);
+	}
+
+	TAILQ_FOREACH(filter, &inetd->filters, link) {
+		if (!filter->ifname[0] || !strcmp(filter->ifname, "*")) {
+			verdict = filter->deny ? FILTER_DROP : FILTER_ACCEPT;
+			continue;
+		}
+
+		ifindex = if_nametoindex(filter->ifname);
+		if (!ifindex) {
+			_d("Cannot find %s for inetd %s filter, yet.", filter->ifname, inetd->name);
+			complete = 0;
+			continue;
+		}
+
+		code[i++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ifindex, 0, 1);
+		code[i++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, filter->deny ? FILTER_DROP : FILTER_ACCEPT);
+	}
+	code[i++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, verdict);
+
+	prog.len    = i;
+	prog.filter = code;
+	if (setsockopt(sd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog))) {
+		_w("Failed attaching socket filter to inetd %s, filtering in userspace: %m", inetd->name);
+		free(code);
+		return -1;
+	}
+	free(code);
+
+	if (link_watch())
+		_w("Failed setting up link watcher, inetd %s filters may be stale.", inetd->name);
+
+	inetd->kfilter = complete;
+	_d("Attached %zu insn socket filter to inetd %s, complete:%d", i, inetd->name, complete);
+
+	return 0;
+}
+
+static void filter_refresh(inetd_t *inetd)
+{
+	filter_attach(inetd, inetd->watcher.fd);
+	for (int i = 0; i < inetd->nshards; i++)
+		filter_attach(inetd, inetd->shard[i].fd);
+}
+
+/* Open, bind, and filter, a new Inet socket for service */
+static int open_socket(inetd_t *inetd)
+{
+	int sd;
+	socklen_t len = sizeof(struct sockaddr);
+	struct sockaddr_in s;
+
 	sd = socket(AF_INET, inetd->type | SOCK_NONBLOCK | SOCK_CLOEXEC, inetd->proto);
 	if (-1 == sd) {
 		logit(LOG_CRIT, "Failed opening inetd socket type %d proto %d", inetd->type, inetd->proto);
@@ -285,9 +1061,12 @@ static int spawn_socket(inetd_t *inetd)
 		return -errno;
 	}
 
+	/* On failure get_stdin() filters in userspace instead */
+	filter_attach(inetd, sd);
+
 	if (inetd->port) {
 		if (inetd->type == SOCK_STREAM) {
-			if (-1 == listen(sd, 10)) {
+			if (-1 == listen(sd, inetd->backlog)) {
 				logit(LOG_CRIT, "Failed listening to inetd service %s", inetd->name);
 				close(sd);
 				return -errno;
@@ -298,12 +1077,84 @@ static int spawn_socket(inetd_t *inetd)
 		}
 	}
 
-	if (uev_io_init(ctx, &inetd->watcher, socket_cb, inetd->svc, sd, UEV_READ)) {
+	return sd;
+}
+
+/* Number of sockets to open for service, see spawn_socket() */
+static int num_sockets(inetd_t *inetd)
+{
+#ifdef SO_REUSEPORT
+	if (inetd->shards > 1 && inetd->type == SOCK_STREAM && inetd->forking)
+		return inetd->shards;
+#endif
+	return 1;
+}
+
+static void close_sockets(inetd_t *inetd)
+{
+	_d("Shutting down inet socket %d ...", inetd->watcher.fd);
+	close(inetd->watcher.fd);
+	inetd->watcher.fd = -1;
+
+	while (inetd->nshards > 0)
+		close(inetd->shard[--inetd->nshards].fd);
+	free(inetd->shard);
+	inetd->shard = NULL;
+}
+
+/*
+ * Launch Inet socket(s) for service.  Forking stream services can be
+ * sharded over several SO_REUSEPORT sockets, each with its own listen
+ * backlog, the kernel then spreads new connections between them.
+ */
+static int spawn_socket(inetd_t *inetd)
+{
+	int sd;
+
+	if (!inetd->type) {
+		logit(LOG_CRIT, "Invalid inetd service %s, skipping ...", inetd->name);
+		return -EINVAL;
+	}
+
+	_d("Spawning server socket for inetd %s, type %s ...", inetd->name, inetd->type == SOCK_STREAM ? "stream" : "dgram");
+	sd = open_socket(inetd);
+	if (sd < 0)
+		return sd;
+
+	/* Redirect helper sets up its own watchers */
+	if (inetd->redir)
+		inetd->watcher.fd = sd;
+	else if (uev_io_init(ctx, &inetd->watcher, socket_cb, inetd->svc, sd, UEV_READ)) {
 		logit(LOG_CRIT, "Failed setting up inetd watcher for %s", inetd->name);
 		close(sd);
 		return -errno;
 	}
 
+#ifdef SO_REUSEPORT
+	if (num_sockets(inetd) < 2)
+		return 0;
+
+	inetd->shard = calloc(inetd->shards - 1, sizeof(uev_t));
+	if (!inetd->shard) {
+		_w("Failed allocating shards for %s, using one socket.", inetd->name);
+		return 0;
+	}
+
+	while (inetd->nshards < inetd->shards - 1) {
+		sd = open_socket(inetd);
+		if (sd < 0)
+			break;
+
+		if (inetd->redir)
+			inetd->shard[inetd->nshards].fd = sd;
+		else if (uev_io_init(ctx, &inetd->shard[inetd->nshards], socket_cb, inetd->svc, sd, UEV_READ)) {
+			close(sd);
+			break;
+		}
+		inetd->nshards++;
+	}
+	_d("Inetd %s sharded over %d sockets", inetd->name, inetd->nshards + 1);
+#endif
 
 	return 0;
 }
@@ -318,6 +1169,18 @@ int inetd_start(inetd_t *inetd)
 	if (sd == -1)
 		return spawn_socket(inetd);
 
+	/* Number of shards may have changed with a .conf reload */
+	if (inetd->nshards + 1 != num_sockets(inetd)) {
+		_d("Re-opening %s socket(s), now %d shards ...", inetd->svc->cmd, num_sockets(inetd));
+		if (!inetd->redir) {
+			unhold(inetd);
+			watchers(inetd, uev_io_stop);
+		}
+		close_sockets(inetd);
+
+		return spawn_socket(inetd);
+	}
+
 	/* Read anything lingering, or clean up socket after failure */
 	len = recv(sd, buf, sizeof(buf), MSG_DONTWAIT);
 	if (len > 0)
@@ -329,8 +1192,12 @@ int inetd_start(inetd_t *inetd)
 		return -errno;
 	}
 
+	/* Filters may have changed with a .conf reload */
+	filter_refresh(inetd);
+
 	_d("Re-starting %s socket watcher ...", inetd->svc->cmd);
-	uev_io_start(&inetd->watcher);
+	unhold(inetd);
+	watchers(inetd, uev_io_start);
 
 	return 0;
 }
@@ -344,17 +1211,17 @@ void inetd_stop(inetd_t *inetd)
 
 	if (inetd->watcher.fd != -1) {
 		_d("Stopping %s socket watcher ...", inetd->svc->cmd);
-		uev_io_stop(&inetd->watcher);
+		if (!inetd->redir) {
+			unhold(inetd);
+			watchers(inetd, uev_io_stop);
+		}
 
 		/*
 		 * For dgram inetd services we block the parent SVC
 		 * and halt the watcher, so don't close the socket!
 		 */
-		if (!svc_is_busy(inetd->svc)) {
-			_d("Shutting down inet socket %d ...", inetd->watcher.fd);
-			close(inetd->watcher.fd);
-			inetd->watcher.fd = -1;
-		}
+		if (!svc_is_busy(inetd->svc))
+			close_sockets(inetd);
 	}
 }
 
@@ -733,6 +1600,8 @@ int inetd_new(inetd_t *inetd, char *name, char *service, char *proto, int forkin
 		name = service;
 	strlcpy(inetd->name, name, sizeof(inetd->name));
 	TAILQ_INIT(&inetd->filters);
+	LIST_INIT(&inetd->peers);
+	inetd_flush_opts(inetd);
 
 	/* Naïve mapping tcp->stream, udp->dgram, other->dgram */
 	if (!strcasecmp(sv->s_proto, "tcp"))
@@ -758,12 +1627,107 @@ int inetd_new(inetd_t *inetd, char *name, char *service, char *proto, int forkin
 
 int inetd_del(inetd_t *inetd)
 {
+	svc_t *svc, *iter = NULL;
+
 	svc_unblock(inetd->svc);
 	inetd_stop(inetd);
 
+	/* Any lingering connections must not refer back to us */
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		if (svc_is_inetd_conn(svc) && svc->inetd.svc == inetd->svc)
+			svc->inetd.svc = NULL;
+	}
+	peer_flush(inetd);
+
 	return inetd_flush(inetd);
 }
 
+/* Throttling options, see inetd_set_opt() */
+static const char *opts[] = {
+	"max:", "perip:", "rate:", "backlog:", "batch:", "shards:", NULL
+};
+
+/* Reset all options to their defaults */
+void inetd_flush_opts(inetd_t *inetd)
+{
+	inetd->max_conn  = 0;
+	inetd->max_perip = 0;
+	inetd->rate      = 0;
+	inetd->burst     = 0;
+	inetd->backlog   = INETD_BACKLOG;
+	inetd->batch     = INETD_BATCH;
+	inetd->shards    = 0;
+}
+
+int inetd_is_opt(char *opt)
+{
+	for (int i = 0; opts[i]; i++) {
+		if (!strncasecmp(opt, opts[i], strlen(opts[i])))
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * inetd_set_opt - Set inetd throttling option
+ * @inetd: Pointer to inetd_t of an inetd service
+ * @opt:   Option, e.g. max:NUM, perip:NUM, or rate:NUM[/BURST]
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero errno exit status on failure.
+ */
+int inetd_set_opt(inetd_t *inetd, char *opt)
+{
+	const char *errstr;
+	char *val, *burst;
+	int num;
+
+	if (!inetd || !opt)
+		return errno = EINVAL;
+
+	val = strchr(opt, ':');
+	if (!val)
+		return errno = EINVAL;
+	*val++ = 0;
+
+	burst = strchr(val, '/');
+	if (burst)
+		*burst++ = 0;
+
+	num = strtonum(val, 0, INT16_MAX, &errstr);
+	if (errstr)
+		return errno = EINVAL;
+
+	if (!strcasecmp(opt, "max")) {
+		inetd->max_conn = num;
+	} else if (!strcasecmp(opt, "perip")) {
+		inetd->max_perip = num;
+	} else if (!strcasecmp(opt, "backlog")) {
+		inetd->backlog = num ? num : INETD_BACKLOG;
+	} else if (!strcasecmp(opt, "batch")) {
+		inetd->batch = num ? num : INETD_BATCH;
+	} else if (!strcasecmp(opt, "shards")) {
+		if (num > INETD_SHARDS)
+			num = INETD_SHARDS;
+		inetd->shards = num;
+	} else if (!strcasecmp(opt, "rate")) {
+		inetd->rate  = num;
+		inetd->burst = num;
+		if (burst) {
+			inetd->burst = strtonum(burst, 1, INT16_MAX, &errstr);
+			if (errstr)
+				return errno = EINVAL;
+		}
+		inetd->credit = inetd->burst * 1000L;
+		inetd->stamp  = now_ms();
+	} else {
+		return errno = EINVAL;
+	}
+
+	return 0;
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
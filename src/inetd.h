@@ -37,6 +37,12 @@ typedef struct inetd_filter {
 	char ifname[IFNAMSIZ];	/* E.g., eth0 */
 } inetd_filter_t;
 
+typedef struct inetd_peer {
+	LIST_ENTRY(inetd_peer) link;
+	struct in_addr addr;	/* Source address of connection(s) */
+	int            count;	/* Number of active connections */
+} inetd_peer_t;
+
 typedef struct {
 	uev_t  watcher;
 	svc_t *svc;		/* svc_t pointer for the socket callback */
@@ -48,10 +54,34 @@ typedef struct {
 	int    forking;
 	int    builtin;		/* Set by built-in inetd services only */
 	int    next_id;		/* Next child job's id */
+	int    backlog;		/* Listen backlog for stream sockets */
+	int    batch;		/* Max connections to accept per wakeup */
+	int    shards;		/* Number of SO_REUSEPORT sockets to use */
+	int    nshards;		/* Number of extra shard sockets opened */
+	uev_t *shard;		/* Extra shard socket watchers */
+	int    kfilter;		/* Socket filter handles all iface filtering */
 	char   name[10];
 	int  (*cmd)(int type);	/* internal inetd service, like 'time' */
 
+	/* Throttling, 0:unlimited */
+	int    max_conn;	/* Max concurrent connections */
+	int    max_perip;	/* Max concurrent connections per source */
+	int    rate;		/* Max new connections per second ... */
+	int    burst;		/* ... with this token bucket depth */
+	int    num_conn;	/* Currently active connections */
+	long   credit;		/* Token bucket, in 1/1000 connections */
+	long   stamp;		/* Time of last refill, in msec */
+	int    held;		/* 1: at max_conn, 2: at max rate */
+	uev_t  holdoff;		/* Timer to resume after max rate */
+
+	struct in_addr peer;	/* inetd_conn: source address */
+	int    counted;		/* inetd_conn: peer counted, see perip: */
+
+	int    redir;		/* Redirect mode, no inetd_conn */
+	struct sockaddr_in backend;
+
 	TAILQ_HEAD(, inetd_filter) filters;
+	LIST_HEAD(, inetd_peer)    peers;
 } inetd_t;
 
 int     inetd_check_loop(struct sockaddr *sa, socklen_t len, char *name);
@@ -61,6 +91,14 @@ void    inetd_stop      (inetd_t *inetd);
 
 int     inetd_new       (inetd_t *inetd, char *name, char *service, char *proto, int forking, svc_t *svc);
 int     inetd_del       (inetd_t *inetd);
+void    inetd_release   (inetd_t *inetd);
+
+int     inetd_redir     (inetd_t *inetd);
+int     inetd_set_redir (inetd_t *inetd, char *addr);
+
+void    inetd_flush_opts(inetd_t *inetd);
+int     inetd_is_opt    (char *opt);
+int     inetd_set_opt   (inetd_t *inetd, char *opt);
 
 svc_t  *inetd_find_svc  (char *path, char *service, char *proto);
 
@@ -27,14 +27,17 @@
 #include <ftw.h>
 #include <ctype.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <paths.h>
 #include <signal.h>
 #include <stdio.h>
 #include <time.h>
 #include <utmp.h>
+#include <sys/wait.h>
 #include <arpa/inet.h>
 #include <lite/lite.h>
 
+#include "cgroup.h"
 #include "client.h"
 #include "cond.h"
 #include "serv.h"
@@ -254,10 +257,10 @@ static int do_cond_show(char *arg)
 	printheader(NULL, "PID     SERVICE               STATUS  CONDITION (+ ON, ~ FLUX, - OFF)", 0);
 
 	for (svc = client_svc_iterator(1); svc; svc = client_svc_iterator(0)) {
-		if (!svc->cond[0])
+		if (!svc_cond(svc)[0])
 			continue;
 
-		cond = cond_get_agg(svc->cond);
+		cond = cond_get_agg(svc_cond(svc));
 
 		printf("%-6d  %-20.20s  ", svc->pid, svc->cmd);
 
@@ -266,7 +269,7 @@ static int do_cond_show(char *arg)
 		else
 			printf("\e[1m%-6.6s\e[0m  ", condstr(cond));
 
-		show_cond_one(svc->cond);
+		show_cond_one(svc_cond(svc));
 		puts("");
 	}
 
@@ -403,6 +406,67 @@ char *runlevel_string(int runlevel, int levels)
 	return lvl;
 }
 
+/* inetd connections share the description of their inetd service */
+static char *desc(svc_t *svc)
+{
+	static char buf[MAX_STR_LEN + 12];
+
+	if (!svc_is_inetd_conn(svc))
+		return svc_desc(svc);
+
+	snprintf(buf, sizeof(buf), "%s connection", svc_desc(svc));
+
+	return buf;
+}
+
+static char *bytes(uint64_t num, char *buf, size_t len)
+{
+	char *unit = "KMGT";
+	double val = num;
+
+	if (num < 1024) {
+		snprintf(buf, len, "%" PRIu64, num);
+		return buf;
+	}
+
+	while ((val /= 1024) >= 1024 && unit[1])
+		unit++;
+	snprintf(buf, len, "%.1f%c", val, *unit);
+
+	return buf;
+}
+
+/* Resource usage, only available when Finit runs services in cgroups */
+static void show_cgroup(char *arg)
+{
+	struct init_request rq = {
+		.magic = INIT_MAGIC,
+		.cmd   = INIT_CMD_SVC_CGROUP,
+	};
+	char cur[16], max[16], rd[16], wr[16];
+	cgroup_stat_t st;
+
+	strlcpy(rq.data, arg, sizeof(rq.data));
+	if (client_send(&rq, sizeof(rq)) || rq.cmd != INIT_CMD_ACK)
+		return;
+
+	memcpy(&st, rq.data, sizeof(st));
+	st.name[sizeof(st.name) - 1] = 0;
+
+	printf("CGroup      : %s, %d process%s\n", st.name, st.nprocs, st.nprocs == 1 ? "" : "es");
+	printf("CPU time    : %" PRIu64 ".%03" PRIu64 "s (user %" PRIu64 ".%03" PRIu64 "s, system %" PRIu64 ".%03" PRIu64 "s)\n",
+	       st.cpu_usec / 1000000, st.cpu_usec / 1000 % 1000,
+	       st.cpu_user / 1000000, st.cpu_user / 1000 % 1000,
+	       st.cpu_system / 1000000, st.cpu_system / 1000 % 1000);
+	if (st.mem_max && st.mem_max != UINT64_MAX)
+		printf("Memory      : %s (max %s)\n", bytes(st.mem_current, cur, sizeof(cur)),
+		       bytes(st.mem_max, max, sizeof(max)));
+	else
+		printf("Memory      : %s\n", bytes(st.mem_current, cur, sizeof(cur)));
+	printf("I/O         : read %s, written %s\n", bytes(st.io_rbytes, rd, sizeof(rd)),
+	       bytes(st.io_wbytes, wr, sizeof(wr)));
+}
+
 /*
  * In verbose mode we skip the header and each service description.
  * This in favor of having all info on one line so a machine can more
@@ -424,11 +488,19 @@ static int show_status(char *arg)
 			return 1;
 
 		printf("Service     : %s\n", svc->cmd);
-		printf("Description : %s\n", svc->desc);
+		printf("Description : %s\n", desc(svc));
 		printf("PID         : %d\n", svc->pid);
 		printf("Uptime      : %s\n", svc->pid ? uptime(now - svc->start_time, buf, sizeof(buf)) : buf);
 		printf("Runlevels   : %s\n", runlevel_string(runlevel, svc->runlevels));
 		printf("Status      : %s\n", svc_status(svc));
+		if (svc->status != -1) {
+			if (WIFSIGNALED(svc->status))
+				printf("Last exit   : signal %d (%s)\n", WTERMSIG(svc->status),
+				       strsignal(WTERMSIG(svc->status)));
+			else
+				printf("Last exit   : status %d\n", WEXITSTATUS(svc->status));
+		}
+		show_cgroup(arg);
 		printf("\n");
 
 		return do_log(svc->cmd);
@@ -466,7 +538,7 @@ static int show_status(char *arg)
 			else
 				name++;
 
-			printf("%-16.16s  %-*.*s\n", name, adj, adj, svc->desc);
+			printf("%-16.16s  %-*.*s\n", name, adj, adj, desc(svc));
 			continue;
 		}
 
@@ -504,8 +576,8 @@ static int show_status(char *arg)
 		{
 			int i;
 
-			for (i = 1; i < MAX_NUM_SVC_ARGS; i++) {
-				strlcat(args, svc->args[i], sizeof(args));
+			for (i = 1; i < svc->conf->argc; i++) {
+				strlcat(args, svc_arg(svc, i), sizeof(args));
 				strlcat(args, " ", sizeof(args));
 			}
 
@@ -516,6 +588,268 @@ static int show_status(char *arg)
 	return 0;
 }
 
+/* Fetch snapshot of runtime statistics for JOB:ID, or NAME[:ID] */
+static int stats_get(char *jobid, svc_stats_t *st)
+{
+	struct init_request rq = {
+		.magic = INIT_MAGIC,
+		.cmd   = INIT_CMD_SVC_STATS,
+	};
+
+	strlcpy(rq.data, jobid, sizeof(rq.data));
+	if (client_send(&rq, sizeof(rq)) || rq.cmd != INIT_CMD_ACK)
+		return 1;
+
+	memcpy(st, rq.data, sizeof(*st));
+
+	return 0;
+}
+
+static char *stats_name(svc_t *svc)
+{
+	char *name = strrchr(svc->cmd, '/');
+
+	return name ? name + 1 : svc->cmd;
+}
+
+static void stats_show(svc_t *svc, svc_stats_t *st)
+{
+	char buf[42];
+	int i;
+
+	printf("Service     : %s\n", svc->cmd);
+	printf("Starts      : %u\n", st->starts);
+	printf("Crashes     : %u\n", st->crashes);
+	printf("Uptime      : %s\n", st->uptime ? uptime(st->uptime, buf, sizeof(buf)) : "0 sec");
+	if (st->ready_ms >= 0)
+		printf("Ready after : %ld.%03ld sec\n", st->ready_ms / 1000, st->ready_ms % 1000);
+	printf("Signals     : %u", st->signals);
+	if (st->last_signal)
+		printf(", last %d (%s)", st->last_signal, strsignal(st->last_signal));
+	printf("\nExit codes  :");
+	for (i = 0; i < MAX_EXIT_CODES; i++) {
+		if (st->exits[i])
+			printf(" %d%s:%u", i, i == MAX_EXIT_CODES - 1 ? "+" : "", st->exits[i]);
+	}
+	printf("\n");
+	if (svc_is_inetd(svc))
+		printf("Connections : %u accepted, %u refused\n", st->accepted, st->refused);
+}
+
+/*
+ * Metrics in Prometheus text format, e.g. for the textfile collector of
+ * node_exporter.  Written to FILE.tmp first, then renamed into place,
+ * so a scraper never sees a partial file.
+ */
+typedef struct {
+	char         name[MAX_ARG_LEN];
+	int          id;
+	int          inetd;
+	svc_stats_t  st;
+} prom_t;
+
+static int prom_all(const prom_t *p)
+{
+	(void)p;
+	return 1;
+}
+
+static int prom_inetd(const prom_t *p)
+{
+	return p->inetd;
+}
+
+static int prom_ready(const prom_t *p)
+{
+	return p->st.ready_ms >= 0;
+}
+
+/*
+ * One metric for all entries in @arr matching @cond(), where @field is
+ * the member of prom_t to print, divided by @div, using @fmt.
+ */
+#define PROM_METRIC(fp, arr, num, metric, type, help, cond, fmt, field, div) \
+	do {								\
+		fprintf(fp, "# HELP " metric " " help "\n");		\
+		fprintf(fp, "# TYPE " metric " " type "\n");		\
+		for (int _i = 0; _i < num; _i++) {			\
+			const prom_t *_p = &arr[_i];			\
+			if (!cond(_p))					\
+				continue;				\
+			fprintf(fp, metric "{name=\"%s\",id=\"%d\"} " fmt "\n", \
+				_p->name, _p->id, _p->field / (div));	\
+		}							\
+	} while (0)
+
+static int stats_prom(char *file)
+{
+	char tmp[PATH_MAX];
+	prom_t *arr = NULL, *p;
+	int i, j, num = 0;
+	svc_t *svc;
+	FILE *fp;
+
+	for (svc = client_svc_iterator(1); svc; svc = client_svc_iterator(0)) {
+		char jobid[16];
+
+		if (svc_is_inetd_conn(svc))
+			continue;
+
+		p = realloc(arr, (num + 1) * sizeof(*arr));
+		if (!p) {
+			free(arr);
+			err(1, "Failed allocating memory");
+		}
+		arr = p;
+		p = &arr[num];
+
+		snprintf(jobid, sizeof(jobid), "%d:%d", svc->job, svc->id);
+		if (stats_get(jobid, &p->st))
+			continue;
+
+		strlcpy(p->name, stats_name(svc), sizeof(p->name));
+		p->id    = svc->id;
+		p->inetd = svc_is_inetd(svc);
+		num++;
+	}
+
+	if (file && file[0]) {
+		snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+		fp = fopen(tmp, "w");
+		if (!fp) {
+			free(arr);
+			err(1, "Failed creating %s", tmp);
+		}
+	} else {
+		fp = stdout;
+	}
+
+	PROM_METRIC(fp, arr, num, "finit_service_starts_total", "counter",
+		    "Number of times the service has been started.", prom_all, "%u", st.starts, 1);
+	PROM_METRIC(fp, arr, num, "finit_service_crashes_total", "counter",
+		    "Number of exits not asked for by finit.", prom_all, "%u", st.crashes, 1);
+	PROM_METRIC(fp, arr, num, "finit_service_signals_total", "counter",
+		    "Number of times the service was killed by a signal.", prom_all, "%u", st.signals, 1);
+	PROM_METRIC(fp, arr, num, "finit_service_last_signal", "gauge",
+		    "Signal that last killed the service, 0 if none.", prom_all, "%d", st.last_signal, 1);
+	PROM_METRIC(fp, arr, num, "finit_service_uptime_seconds_total", "counter",
+		    "Time the service has been running, all runs.", prom_all, "%ld", st.uptime, 1);
+	PROM_METRIC(fp, arr, num, "finit_service_ready_seconds", "gauge",
+		    "Time from fork to pidfile at last start.", prom_ready,
+		    "%.3f", st.ready_ms, 1000.0);
+	PROM_METRIC(fp, arr, num, "finit_inetd_accepted_total", "counter",
+		    "Number of connections accepted by inetd service.", prom_inetd, "%u", st.accepted, 1);
+	PROM_METRIC(fp, arr, num, "finit_inetd_refused_total", "counter",
+		    "Number of connections refused by inetd service.", prom_inetd, "%u", st.refused, 1);
+
+	fprintf(fp, "# HELP finit_service_exits_total Number of exits by exit code, 15 is 15 and above.\n");
+	fprintf(fp, "# TYPE finit_service_exits_total counter\n");
+	for (i = 0; i < num; i++) {
+		for (j = 0; j < MAX_EXIT_CODES; j++) {
+			if (!arr[i].st.exits[j])
+				continue;
+			fprintf(fp, "finit_service_exits_total{name=\"%s\",id=\"%d\",code=\"%d\"} %u\n",
+				arr[i].name, arr[i].id, j, arr[i].st.exits[j]);
+		}
+	}
+	free(arr);
+
+	if (fp == stdout)
+		return 0;
+
+	if (fclose(fp) || rename(tmp, file)) {
+		warn("Failed writing %s", file);
+		remove(tmp);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int do_stats(char *arg)
+{
+	svc_stats_t st;
+	svc_t *svc;
+
+	if (arg && !strncmp(arg, "prom", 4) && (!arg[4] || arg[4] == ' '))
+		return stats_prom(arg[4] ? &arg[5] : NULL);
+
+	if (arg && arg[0]) {
+		svc = client_svc_find(arg);
+		if (!svc || stats_get(arg, &st))
+			return 1;
+
+		stats_show(svc, &st);
+		return 0;
+	}
+
+	if (!verbose)
+		printheader(NULL, "#         STARTS  CRASHES  SIGNALS  UPTIME (s)  READY     SERVICE", 0);
+
+	for (svc = client_svc_iterator(1); svc; svc = client_svc_iterator(0)) {
+		char jobid[16], ready[16] = "N/A";
+
+		if (svc_is_inetd_conn(svc))
+			continue;
+
+		snprintf(jobid, sizeof(jobid), "%d:%d", svc->job, svc->id);
+		if (stats_get(jobid, &st))
+			continue;
+
+		if (st.ready_ms >= 0)
+			snprintf(ready, sizeof(ready), "%ld.%03lds", st.ready_ms / 1000, st.ready_ms % 1000);
+
+		printf("%-9s %6u  %7u  %7u  %10ld  %-8.8s  %s\n", jobid, st.starts, st.crashes,
+		       st.signals, st.uptime, ready, stats_name(svc));
+	}
+
+	return 0;
+}
+
+/*
+ * Time spent in each event loop handler of Finit, and the latency of
+ * the event loop itself, with a histogram of each in decades from
+ * <10us to >=10s.
+ */
+static int do_debug_stats(char *arg)
+{
+	prof_t *arr;
+	int i, j, num, reset = 0;
+
+	if (arg && arg[0]) {
+		if (!string_compare(arg, "reset")) {
+			warnx("Unknown argument '%s', only 'reset' is supported", arg);
+			return 1;
+		}
+		reset = 1;
+	}
+
+	num = client_debug_stats(reset, &arr);
+	if (num < 0)
+		return 1;
+
+	printheader(NULL, "HANDLER               CALLS  TOTAL ms    AVG us    MAX us    "
+		    "<10u <100u   <1m  <10m <100m   <1s  <10s  >10s", 0);
+	for (i = 0; i < num; i++) {
+		prof_t *p = &arr[i];
+		char name[40];
+
+		if (p->name[0])
+			snprintf(name, sizeof(name), "%s:%s", p->kind, p->name);
+		else
+			snprintf(name, sizeof(name), "%s", p->kind);
+
+		printf("%-20.20s %6u %9" PRIu64 " %9" PRIu64 " %9u  ", name, p->calls,
+		       p->total_us / 1000, p->calls ? p->total_us / p->calls : 0, p->max_us);
+		for (j = 0; j < PROF_BUCKETS; j++)
+			printf(" %5u", p->hist[j]);
+		printf("\n");
+	}
+	free(arr);
+
+	return 0;
+}
+
 static int usage(int rc)
 {
 	fprintf(stderr,
@@ -527,6 +861,7 @@ static int usage(int rc)
 		"\n"
 		"Commands:\n"
 		"  debug                     Toggle Finit (daemon) debug\n"
+		"  debug-stats [reset]       Show time spent in Finit event loop handlers\n"
 		"  help                      This help text\n"
 		"  version                   Show Finit version\n"
 		"\n"
@@ -548,6 +883,8 @@ static int usage(int rc)
 		"  restart  <JOB|NAME>[:ID]  Restart (stop/start) service by job# or name\n"
 		"  status   <JOB|NAME>[:ID]  Show service status, by job# or name\n"
 		"  status | show             Show status of services, default command\n"
+		"  stats    [JOB|NAME[:ID]]  Show runtime statistics of services, or one service\n"
+		"  stats    prom [FILE]      Dump statistics in Prometheus format, to FILE or stdout\n"
 		"\n"
 		"  runlevel [0-9]            Show or set runlevel: 0 halt, 6 reboot\n"
 		"  reboot                    Reboot system\n"
@@ -571,6 +908,7 @@ int main(int argc, char *argv[])
 	char *cmd, arg[120];
 	struct command command[] = {
 		{ "debug",    toggle_debug },
+		{ "debug-stats", do_debug_stats },
 		{ "help",     do_help      },
 		{ "version",  show_version },
 
@@ -588,6 +926,7 @@ int main(int argc, char *argv[])
 		{ "restart",  do_restart   },
 		{ "status",   show_status  },
 		{ "show",     show_status  }, /* Convenience alias */
+		{ "stats",    do_stats     },
 
 		{ "runlevel", do_runlevel  },
 		{ "reboot",   do_reboot    },
@@ -630,6 +969,12 @@ int main(int argc, char *argv[])
 			strlcat(arg, " ", sizeof(arg));
 	}
 
+	/* Exact match first, 'debug' is also a prefix of 'debug-stats' */
+	for (c = 0; command[c].cmd; c++) {
+		if (string_compare(command[c].cmd, cmd))
+			return command[c].cb(arg);
+	}
+
 	for (c = 0; command[c].cmd; c++) {
 		if (!string_match(command[c].cmd, cmd))
 			continue;
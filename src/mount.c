@@ -21,9 +21,88 @@
  * THE SOFTWARE.
  */
 
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
 #include <string.h>
 #include <mntent.h>
 #include <sys/mount.h>
+#include <sys/swap.h>
+#include <sys/wait.h>
+#include <lite/lite.h>
+
+#include "helpers.h"
+
+#ifndef MS_LAZYTIME
+#define MS_LAZYTIME (1 << 25)
+#endif
+
+/* fstab entry, copied since getmntent() reuses its buffer */
+typedef struct {
+	char *spec;
+	char *dir;
+	char *type;
+	char *opts;
+	int   nofail;
+	int   done;
+} fs_t;
+
+/*
+ * Mount options handled by the kernel as flags, the rest are passed on
+ * as data to the file system.  Options for mount(8) only are skipped.
+ */
+static const struct {
+	const char    *name;
+	unsigned long  set;
+	unsigned long  clr;
+} mntopts[] = {
+	{ "defaults",    0,                                 0              },
+	{ "ro",          MS_RDONLY,                         0              },
+	{ "rw",          0,                                 MS_RDONLY      },
+	{ "nosuid",      MS_NOSUID,                         0              },
+	{ "suid",        0,                                 MS_NOSUID      },
+	{ "nodev",       MS_NODEV,                          0              },
+	{ "dev",         0,                                 MS_NODEV       },
+	{ "noexec",      MS_NOEXEC,                         0              },
+	{ "exec",        0,                                 MS_NOEXEC      },
+	{ "sync",        MS_SYNCHRONOUS,                    0              },
+	{ "async",       0,                                 MS_SYNCHRONOUS },
+	{ "dirsync",     MS_DIRSYNC,                        0              },
+	{ "mand",        MS_MANDLOCK,                       0              },
+	{ "nomand",      0,                                 MS_MANDLOCK    },
+	{ "noatime",     MS_NOATIME,                        0              },
+	{ "atime",       0,                                 MS_NOATIME     },
+	{ "nodiratime",  MS_NODIRATIME,                     0              },
+	{ "diratime",    0,                                 MS_NODIRATIME  },
+	{ "relatime",    MS_RELATIME,                       0              },
+	{ "norelatime",  0,                                 MS_RELATIME    },
+	{ "strictatime", MS_STRICTATIME,                    0              },
+	{ "lazytime",    MS_LAZYTIME,                       0              },
+	{ "nolazytime",  0,                                 MS_LAZYTIME    },
+	{ "silent",      MS_SILENT,                         0              },
+	{ "loud",        0,                                 MS_SILENT      },
+	{ "bind",        MS_BIND,                           0              },
+	{ "rbind",       MS_BIND | MS_REC,                  0              },
+	{ "user",        MS_NOSUID | MS_NODEV | MS_NOEXEC,  0              },
+	{ "users",       MS_NOSUID | MS_NODEV | MS_NOEXEC,  0              },
+	{ "owner",       MS_NOSUID | MS_NODEV,              0              },
+	{ "group",       MS_NOSUID | MS_NODEV,              0              },
+	{ "nouser",      0,                                 0              },
+	{ "auto",        0,                                 0              },
+	{ "noauto",      0,                                 0              },
+	{ "nofail",      0,                                 0              },
+	{ "_netdev",     0,                                 0              },
+};
+
+/* Options that only mount(8) knows how to handle */
+static const char *mount8opts[] = {
+	"loop", "remount", "move", "encryption", "offset", "sizelimit",
+	"shared", "rshared", "slave", "rslave", "private", "rprivate",
+	"unbindable", "runbindable", NULL
+};
 
 /*
  * SysV init on Debian/Ubuntu skips these protected mount points
@@ -33,7 +112,7 @@
  * and regular filesystems that can be safely unmounted before we do
  * swapoff, and remount / as read-only, respectively.
  */
-static int is_protected(char *dir)
+static int is_protected(const char *dir)
 {
 	size_t i;
 	char *protected[] = {
@@ -59,47 +138,868 @@ static int is_protected(char *dir)
 	return 0;
 }
 
-static struct mntent *iterator(char *fstab)
+/*
+ * Split fstab mount options into mount(2) @flags and @data.
+ *
+ * Returns non-zero if mount(8) is required to handle any option.
+ */
+static int mnt_opts(const char *opts, unsigned long *flags, char *data, size_t len)
 {
-	static FILE *fp = NULL;
-	static struct mntent *mnt;
+	char buf[512], *ptr, *opt;
+	size_t i;
 
-	if (!fp && fstab) {
-		fp = setmntent(fstab, "r");
-		if (!fp)
+	*flags = 0;
+	data[0] = 0;
+	if (!opts)
+		return 0;
+
+	if (strlcpy(buf, opts, sizeof(buf)) >= sizeof(buf))
+		return 1;
+
+	ptr = buf;
+	while ((opt = strsep(&ptr, ","))) {
+		if (!opt[0] || !strncmp(opt, "x-", 2) || !strncmp(opt, "comment=", 8))
+			continue;
+
+		for (i = 0; mount8opts[i]; i++) {
+			if (!strcmp(opt, mount8opts[i]))
+				return 1;
+		}
+
+		for (i = 0; i < NELEMS(mntopts); i++) {
+			if (!strcmp(opt, mntopts[i].name)) {
+				*flags |=  mntopts[i].set;
+				*flags &= ~mntopts[i].clr;
+				break;
+			}
+		}
+		if (i < NELEMS(mntopts))
+			continue;
+
+		if (data[0])
+			strlcat(data, ",", len);
+		if (strlcat(data, opt, len) >= len)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Translate UUID=, LABEL=, etc. to a device node using the udev/mdev
+ * /dev/disk/by-* symlinks.  Returns %NULL if it cannot be resolved,
+ * mount(8) and swapon(8) use libblkid for that.
+ */
+static const char *mnt_spec(const char *spec, char *buf, size_t len)
+{
+	const struct {
+		const char *tag;
+		const char *dir;
+	} tags[] = {
+		{ "UUID=",      "by-uuid"      },
+		{ "LABEL=",     "by-label"     },
+		{ "PARTUUID=",  "by-partuuid"  },
+		{ "PARTLABEL=", "by-partlabel" },
+	};
+	size_t i;
+
+	for (i = 0; i < NELEMS(tags); i++) {
+		size_t n = strlen(tags[i].tag);
+
+		if (strncmp(spec, tags[i].tag, n))
+			continue;
+
+		snprintf(buf, len, "/dev/disk/%s/%s", tags[i].dir, &spec[n]);
+		if (!fexist(buf))
 			return NULL;
+
+		return buf;
 	}
 
+	return spec;
+}
+
+/* File systems that need probing, or a /sbin/mount.TYPE helper */
+static int need_mount8(const char *type)
+{
+	char path[80];
+
+	if (!type || !strcmp(type, "auto") || strchr(type, ','))
+		return 1;
+
+	snprintf(path, sizeof(path), "/sbin/mount.%s", type);
+	if (fexist(path))
+		return 1;
+
+	snprintf(path, sizeof(path), "/usr/sbin/mount.%s", type);
+
+	return fexist(path);
+}
+
+static int is_mounted(const char *dir)
+{
+	struct mntent *mnt;
+	int found = 0;
+	FILE *fp;
+
+	fp = setmntent("/proc/mounts", "r");
+	if (!fp)
+		return 0;
+
 	while ((mnt = getmntent(fp))) {
-		if (is_protected(mnt->mnt_dir))
+		if (!strcmp(mnt->mnt_dir, dir)) {
+			found = 1;
+			break;
+		}
+	}
+	endmntent(fp);
+
+	return found;
+}
+
+/* Is @path @dir, or anything below @dir? */
+static int is_below(const char *path, const char *dir)
+{
+	size_t len = strlen(dir);
+
+	if (!strcmp(dir, "/"))
+		return 1;
+
+	return !strncmp(path, dir, len) && (path[len] == 0 || path[len] == '/');
+}
+
+/* Mount @fs in or below a file system that is not yet mounted? */
+static int depends(fs_t *fs, fs_t *on)
+{
+	if (is_below(fs->dir, on->dir))
+		return 1;
+
+	/* Bind mounts and other file systems with a path as source */
+	return fs->spec[0] == '/' && is_below(fs->spec, on->dir);
+}
+
+/*
+ * Mount one file system using mount(2)
+ *
+ * Returns POSIX OK(0), non-zero if mount(8) should have a go at it.
+ */
+static int mount_one(fs_t *fs)
+{
+	char buf[PATH_MAX], data[512];
+	unsigned long flags;
+	const char *src;
+
+	if (need_mount8(fs->type) || mnt_opts(fs->opts, &flags, data, sizeof(data)))
+		return 1;
+
+	src = mnt_spec(fs->spec, buf, sizeof(buf));
+	if (!src)
+		return 1;
+
+	if (mount(src, fs->dir, fs->type, flags, data[0] ? data : NULL))
+		return 1;
+
+	/* Bind mounts ignore all other flags, need a remount for ro etc. */
+	if ((flags & MS_BIND) && (flags & ~(MS_BIND | MS_REC | MS_SILENT))) {
+		flags |= MS_REMOUNT;
+		if (mount(NULL, fs->dir, NULL, flags, NULL)) {
+			umount(fs->dir);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Fall back to mount(8), also for a better error message */
+static int mount_ext(fs_t *fs)
+{
+	char cmd[PATH_MAX + 16];
+
+	_d("Calling mount(8) for %s on %s ...", fs->spec, fs->dir);
+	snprintf(cmd, sizeof(cmd), "mount -n %s", fs->dir);
+	if (run(cmd))
+		return fs->nofail ? 0 : 1;
+
+	return 0;
+}
+
+/*
+ * Mount all file systems in @fs[] that do not depend on any other
+ * file system not yet mounted.  One forked child for each mount(2),
+ * so slow devices, e.g. with a journal to replay, do not hold back
+ * the others.
+ */
+static int mount_batch(fs_t *fs, int num)
+{
+	pid_t pid[num];
+	int i, j, rc = 0;
+
+	for (i = 0; i < num; i++) {
+		pid[i] = 0;
+		if (fs[i].done)
 			continue;
 
-		return mnt;
+		for (j = 0; j < i; j++) {
+			if (!fs[j].done && depends(&fs[i], &fs[j]))
+				break;
+		}
+		if (j < i) {
+			pid[i] = -1;
+			continue;
+		}
+
+		pid[i] = fork();
+		if (!pid[i])
+			_exit(mount_one(&fs[i]));
+		if (pid[i] < 0)
+			pid[i] = mount_one(&fs[i]) ? -2 : 0;
 	}
 
-	endmntent(fp);
-	fp = NULL;
+	for (i = 0; i < num; i++) {
+		int status = 0;
 
-	return NULL;
+		if (fs[i].done || pid[i] == -1)
+			continue;
+
+		if (pid[i] > 0 && waitpid(pid[i], &status, 0) == -1)
+			status = 1;
+		if (pid[i] == -2 || status)
+			rc += mount_ext(&fs[i]);
+
+		fs[i].done = 1;
+	}
+
+	return rc;
 }
 
-void unmount_tmpfs(void)
+/**
+ * mount_all - Native replacement for mount -na
+ *
+ * Mounts all file systems in /etc/fstab, except swap, noauto, and
+ * already mounted ones, using mount(2) directly.  File systems that
+ * do not depend on each other are mounted in parallel.  Anything the
+ * kernel cannot handle on its own, e.g., file systems that need to be
+ * probed or a mount.TYPE helper, is handed over to mount(8).
+ *
+ * Returns:
+ * POSIX OK(0), or the number of file systems that failed to mount.
+ */
+int mount_all(void)
 {
 	struct mntent *mnt;
+	fs_t *fs = NULL;
+	int i, num = 0, rc = 0;
+	FILE *fp;
+
+	fp = setmntent("/etc/fstab", "r");
+	if (!fp)
+		return run("mount -na");
+
+	while ((mnt = getmntent(fp))) {
+		fs_t *tmp;
+
+		if (!strcmp(mnt->mnt_type, "swap") || !strcmp(mnt->mnt_type, "ignore"))
+			continue;
+		if (hasmntopt(mnt, "noauto"))
+			continue;
+
+		tmp = realloc(fs, (num + 1) * sizeof(fs_t));
+		if (!tmp)
+			break;
+		fs = tmp;
+
+		fs[num].spec   = strdup(mnt->mnt_fsname);
+		fs[num].dir    = strdup(mnt->mnt_dir);
+		fs[num].type   = strdup(mnt->mnt_type);
+		fs[num].opts   = strdup(mnt->mnt_opts);
+		fs[num].nofail = hasmntopt(mnt, "nofail") != NULL;
+		fs[num].done   = 0;
+		if (!fs[num].spec || !fs[num].dir || !fs[num].type || !fs[num].opts) {
+			num++;
+			break;
+		}
+		num++;
+	}
+	endmntent(fp);
+
+	/* Only after reading fstab, getmntent() has one static buffer */
+	for (i = 0; i < num; i++) {
+		if (fs[i].dir && is_mounted(fs[i].dir))
+			fs[i].done = 1;
+	}
 
-	while ((mnt = iterator("/proc/mounts"))) {
-		if (!strcmp("tmpfs", mnt->mnt_fsname))
-			umount(mnt->mnt_dir);
+	if (mnt) {
+		_pe("Failed reading /etc/fstab, calling mount(8)");
+		rc = run("mount -na");
+		goto done;
 	}
+
+	for (;;) {
+		for (i = 0; i < num; i++) {
+			if (!fs[i].done)
+				break;
+		}
+		if (i == num)
+			break;
+
+		rc += mount_batch(fs, num);
+	}
+done:
+	for (i = 0; i < num; i++) {
+		free(fs[i].spec);
+		free(fs[i].dir);
+		free(fs[i].type);
+		free(fs[i].opts);
+	}
+	free(fs);
+
+	return rc;
+}
+
+/*
+ * Swap priority and discard flags, from pri=N and discard[=once|pages]
+ */
+static int swap_flags(struct mntent *mnt)
+{
+	char *opt;
+	int flags = 0;
+
+	opt = hasmntopt(mnt, "pri");
+	if (opt && opt[3] == '=') {
+		int prio = atoi(&opt[4]);
+
+		if (prio >= 0)
+			flags |= SWAP_FLAG_PREFER | ((prio << SWAP_FLAG_PRIO_SHIFT) & SWAP_FLAG_PRIO_MASK);
+	}
+
+	opt = hasmntopt(mnt, "discard");
+	if (opt) {
+		flags |= SWAP_FLAG_DISCARD;
+#ifdef SWAP_FLAG_DISCARD_ONCE
+		if (!strncmp(opt, "discard=once", 12))
+			flags |= SWAP_FLAG_DISCARD_ONCE;
+		else if (!strncmp(opt, "discard=pages", 13))
+			flags |= SWAP_FLAG_DISCARD_PAGES;
+#endif
+	}
+
+	return flags;
 }
 
-void unmount_regular(void)
+/**
+ * swap_on - Native replacement for swapon -ea
+ *
+ * Enables all swap devices and files in /etc/fstab, except noauto,
+ * using swapon(2).  Like -e, devices that do not exist are skipped.
+ * Devices that cannot be resolved, or that the kernel refuses, e.g.
+ * an old swap signature, are handed over to swapon(8).
+ *
+ * Returns:
+ * POSIX OK(0), or the number of swap devices that failed.
+ */
+int swap_on(void)
 {
 	struct mntent *mnt;
+	int rc = 0;
+	FILE *fp;
+
+	fp = setmntent("/etc/fstab", "r");
+	if (!fp)
+		return run("swapon -ea");
+
+	while ((mnt = getmntent(fp))) {
+		char buf[PATH_MAX], cmd[PATH_MAX + 16];
+		const char *src;
+
+		if (strcmp(mnt->mnt_type, "swap") || hasmntopt(mnt, "noauto"))
+			continue;
+
+		src = mnt_spec(mnt->mnt_fsname, buf, sizeof(buf));
+		if (src) {
+			if (!swapon(src, swap_flags(mnt)))
+				continue;
+
+			/* Already enabled, or no such device (-e) */
+			if (errno == EBUSY || errno == ENOENT)
+				continue;
+		}
 
-	while ((mnt = iterator("/proc/mounts"))) {
-		umount(mnt->mnt_dir);
+		_d("Calling swapon(8) for %s ...", mnt->mnt_fsname);
+		snprintf(cmd, sizeof(cmd), "swapon -e %s", mnt->mnt_fsname);
+		if (run(cmd))
+			rc++;
 	}
+	endmntent(fp);
+
+	return rc;
+}
+
+/**
+ * swap_off - Native replacement for swapoff -e -a
+ *
+ * Disables all active swap devices and files, as listed by the kernel
+ * in /proc/swaps, using swapoff(2).  Falls back to swapoff(8) if any
+ * of them cannot be disabled.
+ */
+void swap_off(void)
+{
+	char line[256];
+	int fail = 0;
+	FILE *fp;
+
+	fp = fopen("/proc/swaps", "r");
+	if (!fp) {
+		run("swapoff -e -a");
+		return;
+	}
+
+	/* Skip header: Filename Type Size Used Priority */
+	if (!fgets(line, sizeof(line), fp))
+		goto done;
+
+	while (fgets(line, sizeof(line), fp)) {
+		char *name = strtok(line, " \t");
+
+		if (!name)
+			continue;
+
+		if (swapoff(name) && errno != EINVAL) {
+			_pe("Failed swapoff %s", name);
+			fail = 1;
+		}
+	}
+done:
+	fclose(fp);
+
+	if (fail)
+		run("swapoff -e -a");
+}
+
+/**
+ * remount_root - Native replacement for mount -n -o remount,{ro,rw} /
+ * @rdonly: Remount read-only if set, otherwise read-write
+ *
+ * For read-write the mount options for / in /etc/fstab are used, like
+ * mount(8) does.  Falls back to mount(8), for read-only with all the
+ * variants different mount(8) implementations need.
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero on error.
+ */
+int remount_root(int rdonly)
+{
+	unsigned long flags = 0;
+	char data[512] = "";
+	int rc;
+
+	if (!rdonly) {
+		struct mntent *mnt;
+		FILE *fp;
+
+		fp = setmntent("/etc/fstab", "r");
+		if (fp) {
+			while ((mnt = getmntent(fp))) {
+				if (strcmp(mnt->mnt_dir, "/"))
+					continue;
+
+				if (mnt_opts(mnt->mnt_opts, &flags, data, sizeof(data))) {
+					flags = 0;
+					data[0] = 0;
+				}
+				break;
+			}
+			endmntent(fp);
+		}
+		flags &= ~(MS_RDONLY | MS_BIND | MS_REC);
+	} else {
+		flags = MS_RDONLY;
+	}
+
+	if (!mount(NULL, "/", NULL, flags | MS_REMOUNT, data[0] ? data : NULL))
+		return 0;
+
+	_pe("Failed remounting / %s, calling mount(8)", rdonly ? "read-only" : "read-write");
+	if (!rdonly)
+		return run("mount -n -o remount,rw /");
+
+	rc = run("mount -n -o remount,ro -t dummytype dummydev /");
+	rc = run("mount -n -o remount,ro dummydev /") && rc;
+	rc = run("mount -n -o remount,ro /") && rc;
+
+	return rc;
+}
+
+/* Mount from /proc/self/mountinfo, in the shutdown unmount tree */
+typedef struct {
+	int   id;
+	int   parent;
+	char *dir;
+	char *type;
+	int   children;		/* Not yet unmounted */
+	int   tries;
+	int   state;		/* MNT_MOUNTED, MNT_GONE, ... */
+} mnt_t;
+
+#define MNT_MOUNTED  0
+#define MNT_GONE     1		/* Unmounted, or by propagation */
+#define MNT_DETACHED 2		/* Busy, remounted ro and lazily detached */
+#define MNT_BUSY     3		/* Still mounted */
+#define MNT_KEEP     4		/* Not ours to unmount, still holds its parent */
+
+#define MNT_RETRIES  3
+
+/* Undo octal escapes, e.g. \040 for space, in mountinfo paths */
+static void unescape(char *str)
+{
+	char *dst = str;
+
+	while (*str) {
+		if (str[0] == '\\' && isdigit(str[1]) && isdigit(str[2]) && isdigit(str[3])) {
+			*dst++ = (str[1] - '0') * 64 + (str[2] - '0') * 8 + (str[3] - '0');
+			str += 4;
+			continue;
+		}
+		*dst++ = *str++;
+	}
+	*dst = 0;
+}
+
+/*
+ * Read all mounts from /proc/self/mountinfo.  Each entry knows the
+ * number of mounts on top of it, so we can start with the leaves of
+ * the tree.  Protected mounts, and with @type all mounts of another
+ * file system type, are kept.  They are not unmounted, but still
+ * count as children, e.g., an ext4 on top of a tmpfs.
+ */
+static mnt_t *mnt_tree(const char *type, int *num)
+{
+	char line[1024];
+	mnt_t *mnt = NULL;
+	int i, j, n = 0;
+	FILE *fp;
+
+	fp = fopen("/proc/self/mountinfo", "r");
+	if (!fp)
+		return NULL;
+
+	while (fgets(line, sizeof(line), fp)) {
+		char dir[PATH_MAX], fstype[64];
+		int id, parent;
+		char *sep;
+		mnt_t *tmp;
+
+		/* 36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw */
+		sep = strstr(line, " - ");
+		if (!sep || sscanf(line, "%d %d %*s %*s %4095s", &id, &parent, dir) != 3)
+			continue;
+		if (sscanf(sep + 3, "%63s", fstype) != 1)
+			continue;
+
+		unescape(dir);
+
+		tmp = realloc(mnt, (n + 1) * sizeof(mnt_t));
+		if (!tmp)
+			break;
+		mnt = tmp;
+
+		memset(&mnt[n], 0, sizeof(mnt_t));
+		mnt[n].id     = id;
+		mnt[n].parent = parent;
+		mnt[n].dir    = strdup(dir);
+		mnt[n].type   = strdup(fstype);
+		if (!mnt[n].dir || !mnt[n].type) {
+			free(mnt[n].dir);
+			free(mnt[n].type);
+			break;
+		}
+		if (is_protected(dir) || (type && strcmp(type, fstype)))
+			mnt[n].state = MNT_KEEP;
+		n++;
+	}
+	fclose(fp);
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n; j++) {
+			if (mnt[j].id == mnt[i].parent)
+				mnt[j].children++;
+		}
+	}
+
+	*num = n;
+	return mnt;
+}
+
+static void mnt_gone(mnt_t *mnt, int num, mnt_t *m, int state)
+{
+	int i;
+
+	m->state = state;
+	for (i = 0; i < num; i++) {
+		if (mnt[i].id == m->parent)
+			mnt[i].children--;
+	}
+}
+
+/* Is @link in /proc/PID/ somewhere on or below @dir? */
+static int mnt_holds(const char *link, const char *dir)
+{
+	char path[PATH_MAX];
+	ssize_t len;
+
+	len = readlink(link, path, sizeof(path) - 1);
+	if (len <= 0)
+		return 0;
+	path[len] = 0;
+
+	return is_below(path, dir);
+}
+
+/*
+ * Kill all processes that have their cwd, root, executable, or any
+ * open file on or below @dir.  Skips ourselves, PID 1, and processes
+ * that, like do_kill(), have argv[0] starting with '@'.
+ */
+static void mnt_kill_holders(const char *dir)
+{
+	struct dirent *d;
+	DIR *proc;
+
+	proc = opendir("/proc");
+	if (!proc)
+		return;
+
+	while ((d = readdir(proc))) {
+		char path[64], cmd[2] = { 0 };
+		struct dirent *f;
+		int held = 0;
+		pid_t pid;
+		DIR *fds;
+		FILE *fp;
+
+		pid = atoi(d->d_name);
+		if (pid <= 1 || pid == getpid() || pid == getppid())
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
+		fp = fopen(path, "r");
+		if (!fp)
+			continue;
+		if (!fgets(cmd, sizeof(cmd), fp))
+			cmd[0] = 0;
+		fclose(fp);
+
+		/* Kernel threads have no cmdline */
+		if (!cmd[0] || cmd[0] == '@')
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/%d/cwd", pid);
+		held |= mnt_holds(path, dir);
+		snprintf(path, sizeof(path), "/proc/%d/root", pid);
+		held |= mnt_holds(path, dir);
+		snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+		held |= mnt_holds(path, dir);
+
+		snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+		fds = held ? NULL : opendir(path);
+		while (fds && (f = readdir(fds))) {
+			char fd[80];
+
+			if (f->d_name[0] == '.')
+				continue;
+
+			snprintf(fd, sizeof(fd), "/proc/%d/fd/%s", pid, f->d_name);
+			if (mnt_holds(fd, dir)) {
+				held = 1;
+				break;
+			}
+		}
+		if (fds)
+			closedir(fds);
+
+		if (held) {
+			_d("Killing PID %d, keeps %s busy", pid, dir);
+			kill(pid, SIGKILL);
+		}
+	}
+	closedir(proc);
+}
+
+/* Network file systems may hang forever on an unreachable server */
+static int is_netfs(const char *type)
+{
+	return !strncmp(type, "nfs", 3) || !strcmp(type, "cifs") || !strcmp(type, "smb3");
+}
+
+/*
+ * Last resort for a busy mount: force network file systems, remount
+ * others read-only so they are clean on next boot, and detach it so
+ * the file systems below it can be unmounted.
+ */
+static int mnt_give_up(mnt_t *m)
+{
+	if (is_netfs(m->type) && !umount2(m->dir, MNT_FORCE))
+		return MNT_GONE;
+
+	if (mount(NULL, m->dir, NULL, MS_REMOUNT | MS_RDONLY, NULL)) {
+		_pe("Failed remounting %s read-only", m->dir);
+		return MNT_BUSY;
+	}
+
+	if (umount2(m->dir, MNT_DETACH))
+		return MNT_BUSY;
+
+	return MNT_DETACHED;
+}
+
+/*
+ * Unmount all leaves, mounts without anything mounted on top, at the
+ * same time.  One child per umount(), a slow flush of one file system
+ * does not hold back the others.
+ *
+ * Returns number of mounts that went away.
+ */
+static int mnt_leaves(mnt_t *mnt, int num)
+{
+	pid_t pid[num];
+	int leaf[num];
+	int i, gone = 0;
+
+	/* Snapshot, mnt_gone() below changes the children count */
+	for (i = 0; i < num; i++) {
+		pid[i]  = 0;
+		leaf[i] = mnt[i].state == MNT_MOUNTED && mnt[i].children <= 0;
+		if (!leaf[i])
+			continue;
+
+		pid[i] = fork();
+		if (!pid[i])
+			_exit(umount(mnt[i].dir) ? errno : 0);
+		if (pid[i] < 0)
+			pid[i] = 0;
+	}
+
+	for (i = 0; i < num; i++) {
+		int status = 0, err;
+
+		if (!leaf[i])
+			continue;
+
+		if (pid[i]) {
+			if (waitpid(pid[i], &status, 0) == -1)
+				status = 0;
+			err = WIFEXITED(status) ? WEXITSTATUS(status) : EBUSY;
+		} else {
+			err = umount(mnt[i].dir) ? errno : 0;
+		}
+
+		/* Already gone, e.g., by mount propagation */
+		if (!err || err == EINVAL || err == ENOENT) {
+			mnt_gone(mnt, num, &mnt[i], MNT_GONE);
+			gone++;
+			continue;
+		}
+
+		_d("Failed unmounting %s: %s", mnt[i].dir, strerror(err));
+		if (++mnt[i].tries < MNT_RETRIES) {
+			mnt_kill_holders(mnt[i].dir);
+			continue;
+		}
+
+		mnt_gone(mnt, num, &mnt[i], mnt_give_up(&mnt[i]));
+		gone++;
+	}
+
+	return gone;
+}
+
+/*
+ * Shutdown unmount engine.  Builds the mount tree and unmounts it from
+ * the leaves and up, busy mounts are retried after killing whatever
+ * keeps them busy.  With @report, any file systems still mounted are
+ * logged.
+ *
+ * Returns number of file systems still mounted.
+ */
+static int unmount_tree(const char *type, int report)
+{
+	int i, num = 0, busy = 0;
+	mnt_t *mnt;
+
+	mnt = mnt_tree(type, &num);
+	if (!mnt)
+		return 0;
+
+	while (1) {
+		int retry = 0;
+
+		if (mnt_leaves(mnt, num))
+			continue;
+
+		/* No progress, anything left to retry? */
+		for (i = 0; i < num; i++) {
+			if (mnt[i].state == MNT_MOUNTED && mnt[i].children <= 0)
+				retry = 1;
+		}
+		if (!retry)
+			break;
+
+		/* Give the killed holders a moment to exit */
+		usleep(100000);
+	}
+
+	for (i = 0; i < num; i++) {
+		switch (mnt[i].state) {
+		case MNT_GONE:
+		case MNT_KEEP:
+			break;
+
+		case MNT_DETACHED:
+			if (report)
+				logit(LOG_WARNING, "%s busy, remounted read-only and detached", mnt[i].dir);
+			break;
+
+		default:
+			if (report)
+				logit(LOG_ERR, "%s still mounted", mnt[i].dir);
+			busy++;
+			break;
+		}
+
+		free(mnt[i].dir);
+		free(mnt[i].type);
+	}
+	free(mnt);
+
+	return busy;
+}
+
+/**
+ * unmount_tmpfs - Unmount all tmpfs, before swapoff at shutdown
+ */
+void unmount_tmpfs(void)
+{
+	unmount_tree("tmpfs", 0);
+}
+
+/**
+ * unmount_regular - Unmount all remaining file systems at shutdown
+ *
+ * Except / and the API file systems, see is_protected().  Reports the
+ * file systems that could not be unmounted.
+ *
+ * Returns:
+ * Number of file systems still mounted.
+ */
+int unmount_regular(void)
+{
+	int busy;
+
+	print_desc(NULL, "Unmounting file systems");
+	busy = unmount_tree(NULL, 1);
+	print_result(busy);
+
+	return busy;
 }
 
 /**
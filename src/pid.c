@@ -93,30 +93,38 @@ char *pid_get_name(pid_t pid, char *name, size_t len)
 	return pname;
 }
 
-char *pid_file(svc_t *svc)
+static char *pid_default(svc_t *svc)
 {
 	char fn[MAX_ARG_LEN];
 	static char path[MAX_ARG_LEN];
 
-	if (svc->pidfile[0]) {
-		if (svc->pidfile[0] == '!')
-			return &svc->pidfile[1];
-		return svc->pidfile;
-	}
-
 	snprintf(fn, sizeof(fn), "%s%s.pid", _PATH_VARRUN, basename(svc->cmd));
 
 	return pid_runpath(fn, path, sizeof(path));
 }
 
+char *pid_file(svc_t *svc)
+{
+	char *pidfile = svc_pidfile(svc);
+
+	if (pidfile[0]) {
+		if (pidfile[0] == '!')
+			return &pidfile[1];
+		return pidfile;
+	}
+
+	return pid_default(svc);
+}
+
 int pid_file_create(svc_t *svc)
 {
+	char *pidfile = svc_pidfile(svc);
 	FILE *fp;
 
-	if (!svc->pidfile[0] || svc->pidfile[0] == '!')
+	if (!pidfile[0] || pidfile[0] == '!')
 		return 1;
 
-	fp = fopen(svc->pidfile, "w");
+	fp = fopen(pidfile, "w");
 	if (!fp)
 		return 1;
 	fprintf(fp, "%d\n", svc->pid);
@@ -124,27 +132,27 @@ int pid_file_create(svc_t *svc)
 	return fclose(fp);
 }
 
-static int pid_realpath(svc_t *svc, char *file)
+static int pid_realpath(svc_t *svc, svc_conf_buf_t *buf, char *file)
 {
 	int not = 0;
 
 	if (!file)
-		file = pid_file(svc);
+		file = pid_default(svc);
 
 	if (file[0] == '!') {
 		not = 1;
 		file++;
 	}
 
-	pid_runpath(file, &svc->pidfile[not], sizeof(svc->pidfile) - not);
+	pid_runpath(file, &buf->pidfile[not], sizeof(buf->pidfile) - not);
 	if (not)
-		svc->pidfile[0] = '!';
+		buf->pidfile[0] = '!';
 
 	return 0;
 }
 
 /*
- * This function parses a PID file @arg for @svc.
+ * This function parses a PID file @arg for @svc, into @buf.
  *
  * The logic is explained below.  Please note that using the first form
  * of the syntax not only creates and removes the PID file, but it also
@@ -170,7 +178,7 @@ static int pid_realpath(svc_t *svc, char *file)
  *
  * Note, nothing is created or removed by Finit in this latter form.
  */
-int pid_file_parse(svc_t *svc, char *arg)
+int pid_file_parse(svc_t *svc, svc_conf_buf_t *buf, char *arg)
 {
 	/* Sanity check ... */
 	if (!arg || !arg[0])
@@ -183,7 +191,7 @@ int pid_file_parse(svc_t *svc, char *arg)
 
 		arg += 4;
 		if ((arg[0] == '!' && arg[1] == '/') || arg[0] == '/')
-			return pid_realpath(svc, arg);
+			return pid_realpath(svc, buf, arg);
 
 		if (arg[0] == '!') {
 			arg++;
@@ -194,12 +202,12 @@ int pid_file_parse(svc_t *svc, char *arg)
 		if (len > 4 && strcmp(&path[len - 4], ".pid"))
 			strlcat(path, ".pid", sizeof(path));
 
-		return pid_realpath(svc, path);
+		return pid_realpath(svc, buf, path);
 	}
 
 	/* 'pid' arg, no argument following */
 	if (!strcmp(arg, "pid"))
-		return pid_realpath(svc, NULL);
+		return pid_realpath(svc, buf, NULL);
 
 	return 1;
 }
@@ -32,7 +32,7 @@ char *pid_get_name    (pid_t pid, char *name, size_t len);
 
 char *pid_file        (svc_t *svc);
 int   pid_file_create (svc_t *svc);
-int   pid_file_parse  (svc_t *svc, char *arg);
+int   pid_file_parse  (svc_t *svc, svc_conf_buf_t *buf, char *arg);
 
 static inline char *pid_runpath(char *file, char *path, size_t len)
 {
@@ -0,0 +1,289 @@
+/* pidfd based supervision of child processes
+ *
+ * Copyright (c) 2026  agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Children are created with fork() and a pidfd is opened for them with
+ * pidfd_open().  The pidfd is watched for exit by libuEv, with the
+ * service or TTY as the callback argument.  No lookup by PID is needed
+ * when a child exits, and the exit status is not lost.
+ *
+ * These children still raise SIGCHLD, which may be handled before the
+ * pidfd is.  The SIGCHLD handler therefore hands them over to their
+ * watcher, see pidfd_exited(), and only collects all other processes,
+ * e.g., orphans reparented to PID 1.  On kernels without pidfd_open()
+ * (< 5.3) the SIGCHLD handler collects all children.
+ */
+
+#include "config.h"		/* Generated by configure script */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "finit.h"
+#include "log.h"
+#include "pidfd.h"
+#include "private.h"
+
+/* Child with a pidfd, in the watcher given to pidfd_fork() */
+typedef struct child {
+	LIST_ENTRY(child) link;
+	uev_t *w;
+	pid_t  pid;
+} child_t;
+
+/* Child of a service that has been removed */
+typedef struct {
+	uev_t  watcher;
+	pid_t  pid;
+} orphan_t;
+
+/* Hashed by PID, the SIGCHLD handler looks up every exited child */
+#define CHILD_HASH 64
+static LIST_HEAD(, child) children[CHILD_HASH];
+
+#ifdef __NR_pidfd_open
+static int supported = 1;
+#else
+static int supported = 0;
+#endif
+
+static int pidfd_open_(pid_t pid)
+{
+#ifdef __NR_pidfd_open
+	return syscall(__NR_pidfd_open, pid, 0);
+#else
+	return errno = ENOSYS, -1;
+#endif
+}
+
+static child_t *child_find(pid_t pid)
+{
+	child_t *c;
+
+	LIST_FOREACH(c, &children[pid % CHILD_HASH], link) {
+		if (c->pid == pid)
+			return c;
+	}
+
+	return NULL;
+}
+
+/* Stop watching child @pid of @w, it has been collected */
+static void child_forget(uev_t *w, pid_t pid)
+{
+	child_t *c;
+
+	c = child_find(pid);
+	if (c && c->w == w) {
+		LIST_REMOVE(c, link);
+		free(c);
+	}
+
+	if (w->fd != -1) {
+		uev_io_stop(w);
+		close(w->fd);
+		w->fd = -1;
+	}
+}
+
+/**
+ * pidfd_fork - Create child process, with exit notification
+ * @w:   Watcher, called when the child exits, must not be active
+ * @cb:  Callback, should call pidfd_wait() to collect the child
+ * @arg: Callback argument
+ *
+ * Works like fork(), but in the parent @w is set up to call @cb when
+ * the child exits.  On older kernels, or if the child cannot be watched,
+ * @w->fd is set to -1, and the exit is reported by the SIGCHLD handler
+ * calling service_monitor().
+ *
+ * Returns:
+ * PID of child to parent, zero to child, and -1 on error.
+ */
+pid_t pidfd_fork(uev_t *w, uev_cb_t *cb, void *arg)
+{
+	child_t *c;
+	pid_t pid;
+	int fd;
+
+	w->fd = -1;
+
+	pid = fork();
+	if (pid <= 0 || !supported)
+		return pid;
+
+	fd = pidfd_open_(pid);
+	if (fd == -1) {
+		if (errno == ENOSYS) {
+			_d("No pidfd_open(), using SIGCHLD for all children.");
+			supported = 0;
+		} else
+			_pe("Failed opening pidfd for PID %d, using SIGCHLD", pid);
+		return pid;
+	}
+
+	c = malloc(sizeof(*c));
+	if (!c || uev_io_init(ctx, w, cb, arg, fd, UEV_READ)) {
+		_pe("Cannot watch PID %d, using SIGCHLD", pid);
+		close(fd);
+		free(c);
+		w->fd = -1;
+		return pid;
+	}
+
+	c->w   = w;
+	c->pid = pid;
+	LIST_INSERT_HEAD(&children[pid % CHILD_HASH], c, link);
+
+	return pid;
+}
+
+/**
+ * pidfd_exited - Hand over exited child to its pidfd watcher
+ * @pid: PID of exited, not yet collected, child
+ *
+ * Called by the SIGCHLD handler, which may run before the pidfd of a
+ * child from pidfd_fork() is reported readable.  The callback of the
+ * watcher is called to collect the child.
+ *
+ * Returns:
+ * Non-zero if @pid was collected by its watcher, otherwise zero and
+ * the caller should collect it.
+ */
+int pidfd_exited(pid_t pid)
+{
+	child_t *c;
+	uev_t *w;
+
+	c = child_find(pid);
+	if (!c)
+		return 0;
+
+	w = c->w;
+	w->cb(w, w->arg, UEV_READ);
+
+	/* Not collected by the callback, leave it to the caller */
+	if (child_find(pid)) {
+		child_forget(w, pid);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * pidfd_wait - Collect child process created by pidfd_fork()
+ * @w:       Watcher given to pidfd_fork()
+ * @pid:     PID of child
+ * @status:  Pointer to exit status, as from waitpid(), or %NULL
+ * @options: Options to waitpid(), e.g. %WNOHANG
+ *
+ * When the child has been collected, or cannot be, @w is stopped and
+ * the pidfd is closed.
+ *
+ * Returns:
+ * Same as waitpid(), i.e., @pid when collected, zero if still running
+ * and %WNOHANG is given, or -1 on error.
+ */
+pid_t pidfd_wait(uev_t *w, pid_t pid, int *status, int options)
+{
+	pid_t rc;
+
+	/* Already collected, never wait for any child */
+	if (pid <= 0) {
+		errno = ECHILD;
+		rc = -1;
+	} else {
+		do {
+			rc = waitpid(pid, status, options);
+		} while (rc == -1 && errno == EINTR);
+	}
+
+	if (rc)
+		child_forget(w, pid);
+
+	return rc;
+}
+
+static void orphan_cb(uev_t *w, void *arg, int events)
+{
+	orphan_t *orphan = (orphan_t *)arg;
+	int status = 0;
+
+	if (!pidfd_wait(w, orphan->pid, &status, WNOHANG))
+		return;
+
+	service_monitor(orphan->pid, status);
+	free(orphan);
+}
+
+/**
+ * pidfd_release - Hand over child to be collected when it exits
+ * @w:   Watcher given to pidfd_fork()
+ * @pid: PID of child, still running
+ *
+ * Called when the owner of @w goes away before its child has exited,
+ * e.g., a service that is removed while it is still stopping.
+ */
+void pidfd_release(uev_t *w, pid_t pid)
+{
+	orphan_t *orphan;
+	child_t *c;
+	int fd = w->fd;
+
+	c = child_find(pid);
+	if (!c || c->w != w || fd == -1)
+		return;
+
+	orphan = calloc(1, sizeof(*orphan));
+	if (!orphan) {
+		_pe("Cannot watch PID %d, using SIGCHLD", pid);
+		child_forget(w, pid);
+		return;
+	}
+
+	uev_io_stop(w);
+	w->fd = -1;
+
+	if (uev_io_init(ctx, &orphan->watcher, orphan_cb, orphan, fd, UEV_READ)) {
+		_pe("Cannot watch PID %d, using SIGCHLD", pid);
+		LIST_REMOVE(c, link);
+		free(c);
+		close(fd);
+		free(orphan);
+		return;
+	}
+	orphan->pid = pid;
+	c->w = &orphan->watcher;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -26,6 +26,7 @@
 #include <dirent.h>		/* readdir() et al */
 #include <poll.h>
 #include <string.h>
+#include <sys/wait.h>
 #include <lite/lite.h>
 #include <lite/queue.h>		/* BSD sys/queue.h API */
 
@@ -34,8 +35,11 @@
 #include "finit.h"
 #include "helpers.h"
 #include "plugin.h"
+#include "pidfd.h"
 #include "private.h"
+#include "prof.h"
 #include "service.h"
+#include "sig.h"
 
 #define is_io_plugin(p) ((p)->io.cb && (p)->io.fd > 0)
 #define SEARCH_PLUGIN(str)						\
@@ -47,10 +51,80 @@
 static char *plugpath = NULL; /* Set by first load. */
 static TAILQ_HEAD(plugin_head, plugin) plugins  = TAILQ_HEAD_INITIALIZER(plugins);
 
-#ifndef ENABLE_STATIC
-static void check_plugin_depends(plugin_t *plugin);
-#endif
+/* Additional I/O watcher of a plugin, see plugin_io_add() */
+struct plugin_io {
+	LIST_ENTRY(plugin_io) link;
+
+	plugin_t  *p;
+	uev_t      watcher;
+	int        started;
+
+	int        fd, flags;
+	void      *arg;
+	void     (*cb)(void *arg, int fd, int events);
+};
+
+/* Subscribers of each hook, in plugin list order, rebuilt on changes */
+static struct {
+	plugin_t **p;
+	int        num;
+	int        async;		/* Number of async callbacks */
+} hooks[HOOK_MAX_NUM];
+
+/* Does plugin @p list @dep in its .depends? */
+static int depends_on(plugin_t *p, plugin_t *dep)
+{
+	char *name = basename(dep->name);
+	int i;
+
+	for (i = 0; i < PLUGIN_DEP_MAX && p->depends[i]; i++) {
+		size_t len = strlen(name);
+
+		if (!strncmp(p->depends[i], name, len) &&
+		    (!p->depends[i][len] || !strcmp(&p->depends[i][len], ".so")))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Rebuild subscriber arrays of all hooks from the plugin list.  Cheap
+ * enough to redo on every plugin_register(), and it means dispatching
+ * a hook only touches the plugins that subscribe to it.
+ */
+static void hook_index(void)
+{
+	plugin_t *p, *tmp;
+	int i;
 
+	for (i = 0; i < HOOK_MAX_NUM; i++) {
+		free(hooks[i].p);
+		hooks[i].p     = NULL;
+		hooks[i].num   = 0;
+		hooks[i].async = 0;
+	}
+
+	PLUGIN_ITERATOR(p, tmp) {
+		for (i = 0; i < HOOK_MAX_NUM; i++) {
+			plugin_t **arr;
+
+			if (!p->hook[i].cb)
+				continue;
+
+			arr = realloc(hooks[i].p, (hooks[i].num + 1) * sizeof(plugin_t *));
+			if (!arr) {
+				_pe("Failed adding %s to hook %d, skipping", p->name, i);
+				continue;
+			}
+
+			hooks[i].p = arr;
+			hooks[i].p[hooks[i].num++] = p;
+			if (p->hook[i].async)
+				hooks[i].async++;
+		}
+	}
+}
 
 static char *trim_ext(char *name)
 {
@@ -95,12 +169,8 @@ int plugin_register(plugin_t *plugin)
 		return 0;
 	}
 
-#ifndef ENABLE_STATIC
-	/* Resolve plugin dependencies */
-	check_plugin_depends(plugin);
-#endif
-
 	TAILQ_INSERT_TAIL(&plugins, plugin, link);
+	hook_index();
 
 	return 0;
 }
@@ -110,9 +180,12 @@ int plugin_unregister(plugin_t *plugin)
 {
 	if (is_io_plugin(plugin))
 		uev_io_stop(&plugin->watcher);
+	while (!LIST_EMPTY(&plugin->fds))
+		plugin_io_del(plugin, LIST_FIRST(&plugin->fds)->fd);
 
 #ifndef ENABLE_STATIC
 	TAILQ_REMOVE(&plugins, plugin, link);
+	hook_index();
 
 	_d("%s exiting ...", plugin->name);
 	free(plugin->name);
@@ -163,6 +236,12 @@ plugin_t *plugin_find(char *name)
 		SEARCH_PLUGIN(path);
 	}
 
+	/* Built-in plugins are named after their __FILE__ */
+	PLUGIN_ITERATOR(p, tmp) {
+		if (!strcmp(basename(p->name), name))
+			return p;
+	}
+
 	errno = ENOENT;
 	return NULL;
 }
@@ -179,11 +258,233 @@ const char *plugin_hook_str(hook_point_t no)
 
 int plugin_exists(hook_point_t no)
 {
-	plugin_t *p, *tmp;
+	return hooks[no].num > 0;
+}
 
-	PLUGIN_ITERATOR(p, tmp) {
-		if (p->hook[no].cb)
+/*
+ * One call of plugin_run_hook() with async hooks.  Each hook callback
+ * is a job, started when all jobs of plugins it depends on are done.
+ */
+#define JOB_WAIT 0
+#define JOB_RUN  1
+#define JOB_DONE 2
+
+struct hook_run;
+
+typedef struct {
+	plugin_t        *p;
+	struct hook_run *run;
+
+	int              state;
+	pid_t            pid;
+	uint64_t         start;
+
+	uev_t            watcher;	/* pidfd of helper */
+	uev_t            timer;
+} hook_job_t;
+
+typedef struct hook_run {
+	TAILQ_ENTRY(hook_run) link;
+
+	hook_point_t     no;
+	void            *arg;
+
+	int              num;
+	int              pending;
+	hook_job_t       job[];
+} hook_run_t;
+
+static TAILQ_HEAD(, hook_run) hook_runs = TAILQ_HEAD_INITIALIZER(hook_runs);
+
+static void hook_step(hook_run_t *run);
+
+/* Time spent, for debug and initctl debug-stats */
+static void hook_account(hook_point_t no, plugin_t *p, uint64_t start)
+{
+	uint64_t usec = prof_now() - start;
+	int timeout = p->hook[no].timeout ?: PLUGIN_HOOK_TIMEOUT;
+
+	_d("%s hook %s done in %llu.%03llu msec", basename(p->name), hook_cond[no],
+	   (unsigned long long)usec / 1000, (unsigned long long)usec % 1000);
+	if (!p->hook[no].async && usec / 1000 > (uint64_t)timeout)
+		logit(LOG_WARNING, "%s hook %s blocked Finit for %llu msec, consider making it async",
+		      basename(p->name), hook_cond[no], (unsigned long long)usec / 1000);
+
+	prof_add("hook", basename(p->name), start);
+}
+
+/*
+ * All callbacks of a hook are done, set its condition.  Runtime hooks,
+ * like HOOK_SVC_START, have no condition so nothing can wait for them.
+ */
+static void hook_done(hook_point_t no)
+{
+	if (!strcmp(hook_cond[no], "nop"))
+		return;
+
+	cond_set_oneshot(hook_cond[no]);
+	service_step_all(SVC_TYPE_RUNTASK);
+}
+
+static void hook_collect(hook_job_t *job, int status)
+{
+	hook_run_t *run = job->run;
+	plugin_t *p = job->p;
+
+	uev_timer_stop(&job->timer);
+	job->state = JOB_DONE;
+	job->pid   = 0;
+	run->pending--;
+
+	hook_account(run->no, p, job->start);
+	if (status)
+		_d("%s hook %s exited with status %d", basename(p->name), hook_cond[run->no], status);
+	if (p->hook[run->no].done)
+		p->hook[run->no].done(run->arg ? run->arg : p->hook[run->no].arg, status);
+
+	hook_step(run);
+}
+
+static void hook_exit_cb(uev_t *w, void *arg, int events)
+{
+	hook_job_t *job = (hook_job_t *)arg;
+	int status = 0;
+
+	if (pidfd_wait(w, job->pid, &status, WNOHANG) <= 0)
+		return;
+
+	hook_collect(job, WIFSIGNALED(status) ? -1 : WEXITSTATUS(status));
+}
+
+static void hook_timeout_cb(uev_t *w, void *arg, int events)
+{
+	hook_job_t *job = (hook_job_t *)arg;
+	hook_point_t no = job->run->no;
+
+	logit(LOG_WARNING, "%s hook %s timed out after %d msec, killing it", basename(job->p->name),
+	      hook_cond[no], job->p->hook[no].timeout ?: PLUGIN_HOOK_TIMEOUT);
+	kill(job->pid, SIGKILL);
+}
+
+/*
+ * Call the hook of @job, in a helper process if it is async.  Returns
+ * non-zero if the job is done, i.e. it was called in PID 1.
+ */
+static int hook_start(hook_job_t *job)
+{
+	hook_run_t *run = job->run;
+	plugin_t *p = job->p;
+	void *arg = run->arg ? run->arg : p->hook[run->no].arg;
+
+	job->state = JOB_RUN;
+	job->start = prof_now();
+
+	if (p->hook[run->no].async) {
+		int timeout = p->hook[run->no].timeout ?: PLUGIN_HOOK_TIMEOUT;
+
+		_d("Starting %s hook n:o %d (arg: %p) in background ...", basename(p->name), run->no, arg);
+		job->pid = pidfd_fork(&job->watcher, hook_exit_cb, job);
+		if (!job->pid) {
+			sig_unblock();
+			p->hook[run->no].cb(arg);
+			_exit(0);
+		}
+		if (job->pid > 0) {
+			uev_timer_init(ctx, &job->timer, hook_timeout_cb, job, timeout, 0);
+			return 0;
+		}
+
+		_pe("Failed forking %s hook, calling it directly", basename(p->name));
+		job->pid = 0;
+	}
+
+	_d("Calling %s hook n:o %d (arg: %p) ...", basename(p->name), run->no, arg);
+	p->hook[run->no].cb(arg);
+	job->state = JOB_DONE;
+	run->pending--;
+	hook_account(run->no, p, job->start);
+
+	return 1;
+}
+
+/* Can @job start, or is any plugin it depends on not yet done? */
+static int hook_ready(hook_run_t *run, hook_job_t *job)
+{
+	int i;
+
+	for (i = 0; i < run->num; i++) {
+		hook_job_t *dep = &run->job[i];
+
+		if (dep == job || dep->state == JOB_DONE)
+			continue;
+		if (depends_on(job->p, dep->p))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Start all jobs that can start, finish the run when all are done */
+static void hook_step(hook_run_t *run)
+{
+	int i, running;
+
+again:
+	running = 0;
+	for (i = 0; i < run->num; i++) {
+		hook_job_t *job = &run->job[i];
+
+		if (job->state == JOB_RUN)
+			running++;
+		if (job->state != JOB_WAIT || !hook_ready(run, job))
+			continue;
+
+		/* Something completed, may have unblocked earlier jobs */
+		if (hook_start(job))
+			goto again;
+		running++;
+	}
+
+	if (run->pending && !running) {
+		for (i = 0; i < run->num; i++) {
+			if (run->job[i].state == JOB_WAIT)
+				break;
+		}
+
+		_e("Circular dependency in %s hooks, calling %s anyway", hook_cond[run->no],
+		   basename(run->job[i].p->name));
+		if (hook_start(&run->job[i]))
+			goto again;
+		return;
+	}
+
+	if (run->pending)
+		return;
+
+	TAILQ_REMOVE(&hook_runs, run, link);
+	hook_done(run->no);
+	free(run);
+}
+
+/*
+ * Collect helper of async hook, on kernels without pidfd support,
+ * called by service_monitor().
+ */
+int plugin_hook_lost(pid_t pid, int status)
+{
+	hook_run_t *run;
+	int i;
+
+	TAILQ_FOREACH(run, &hook_runs, link) {
+		for (i = 0; i < run->num; i++) {
+			hook_job_t *job = &run->job[i];
+
+			if (job->state != JOB_RUN || job->pid != pid)
+				continue;
+
+			hook_collect(job, WIFSIGNALED(status) ? -1 : WEXITSTATUS(status));
 			return 1;
+		}
 	}
 
 	return 0;
@@ -192,32 +493,42 @@ int plugin_exists(hook_point_t no)
 /* Some hooks are called with a fixed argument, like HOOK_SVC_LOST */
 void plugin_run_hook(hook_point_t no, void *arg)
 {
-	static int last = -1;
-	plugin_t *p, *tmp;
+	hook_run_t *run;
+	int i, num = hooks[no].num;
 
-	/*
-	 * End recursion: any plugin hook => start service => SVC start
-	 * hook => start service ... err ... wait a second
-	 */
-	if (HOOK_SVC_START == last)
-		return;
+	/* Shutdown hooks must be done before we continue */
+	if (!hooks[no].async || HOOK_SHUTDOWN == no)
+		goto sync;
 
-	PLUGIN_ITERATOR(p, tmp) {
-		if (p->hook[no].cb) {
-			_d("Calling %s hook n:o %d (arg: %p) ...", basename(p->name), no, arg);
-			p->hook[no].cb(arg ? arg : p->hook[no].arg);
-		}
+	run = calloc(1, sizeof(*run) + num * sizeof(hook_job_t));
+	if (!run) {
+		_pe("Failed starting %s hooks in background", hook_cond[no]);
+		goto sync;
 	}
 
-	/* Guard against infinite recursion */
-	if (HOOK_SVC_START == no)
-		last = no;
+	run->no      = no;
+	run->arg     = arg;
+	run->num     = num;
+	run->pending = num;
+	for (i = 0; i < num; i++) {
+		run->job[i].p   = hooks[no].p[i];
+		run->job[i].run = run;
+	}
 
-	cond_set_oneshot(hook_cond[no]);
-	service_step_all(SVC_TYPE_RUNTASK);
+	TAILQ_INSERT_TAIL(&hook_runs, run, link);
+	hook_step(run);
+	return;
+sync:
+	for (i = 0; i < num; i++) {
+		plugin_t *p = hooks[no].p[i];
+		uint64_t t0 = prof_now();
+
+		_d("Calling %s hook n:o %d (arg: %p) ...", basename(p->name), no, arg);
+		p->hook[no].cb(arg ? arg : p->hook[no].arg);
+		hook_account(no, p, t0);
+	}
 
-	if (HOOK_SVC_START == no)
-		last = -1;
+	hook_done(no);
 }
 
 /* Regular hooks are called with the registered plugin's argument */
@@ -236,21 +547,61 @@ static void generic_io_cb(uev_t *w, void *arg, int events)
 	plugin_t *p = (plugin_t *)arg;
 
 	if (is_io_plugin(p) && p->io.fd == w->fd) {
+		int persist = p->io.persist || (p->io.flags & PLUGIN_IO_EDGE);
+		uint64_t t0 = prof_now();
+
 		/* Stop watcher, callback may close descriptor on us ... */
-		uev_io_stop(w);
+		if (!persist)
+			uev_io_stop(w);
 
 		_d("Calling I/O %s from runloop...", basename(p->name));
 		p->io.cb(p->io.arg, w->fd, events);
 
 		/* Update fd, may be changed by plugin callback, e.g., if FIFO */
-		uev_io_set(w, p->io.fd, p->io.flags);
+		if (!persist || p->io.fd != w->fd)
+			uev_io_set(w, p->io.fd, p->io.flags);
+		prof_add("plugin", basename(p->name), t0);
+	}
+}
+
+/* Callback for plugin_io_add() descriptors, these stay armed */
+static void extra_io_cb(uev_t *w, void *arg, int events)
+{
+	struct plugin_io *io = (struct plugin_io *)arg;
+	plugin_t *p = io->p;	/* Callback may plugin_io_del() */
+	uint64_t t0 = prof_now();
+
+	_d("Calling I/O %s fd %d from runloop...", basename(p->name), io->fd);
+	io->cb(io->arg, io->fd, events);
+	prof_add("plugin", basename(p->name), t0);
+}
+
+static int extra_io_start(struct plugin_io *io)
+{
+	if (io->started)
+		return 0;
+
+	if (uev_io_init(ctx, &io->watcher, extra_io_cb, io, io->fd, io->flags)) {
+		_e("Failed setting up I/O plugin %s fd %d", basename(io->p->name), io->fd);
+		return 1;
 	}
+	io->started = 1;
+
+	return 0;
 }
 
 int plugin_io_init(plugin_t *p)
 {
+	struct plugin_io *io;
+	int fail = 0;
+
+	LIST_FOREACH(io, &p->fds, link) {
+		if (extra_io_start(io))
+			fail++;
+	}
+
 	if (!is_io_plugin(p))
-		return 0;
+		return fail;
 
 	_d("Initializing plugin %s for I/O", basename(p->name));
 	if (uev_io_init(ctx, &p->watcher, generic_io_cb, p, p->io.fd, p->io.flags)) {
@@ -258,9 +609,89 @@ int plugin_io_init(plugin_t *p)
 		return 1;
 	}
 
+	return fail;
+}
+
+/**
+ * plugin_io_add - Watch one more descriptor for a plugin
+ * @p:     Plugin, may be called before plugin_register()
+ * @fd:    Descriptor to watch
+ * @flags: %PLUGIN_IO_READ, %PLUGIN_IO_WRITE, optionally %PLUGIN_IO_EDGE
+ * @cb:    Callback, called with @arg, @fd, and the events
+ * @arg:   Optional argument to @cb
+ *
+ * For plugins that need more than the @io descriptor, e.g. one socket
+ * per protocol.  The watcher stays armed while @cb runs, so @cb must
+ * not close @fd, call plugin_io_del() first.  Before Finit has set up
+ * its event loop the watcher is started by plugin_io_init().
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero otherwise.
+ */
+int plugin_io_add(plugin_t *p, int fd, int flags, void (*cb)(void *arg, int fd, int events), void *arg)
+{
+	struct plugin_io *io;
+
+	if (!p || fd < 0 || !cb) {
+		errno = EINVAL;
+		return 1;
+	}
+
+	io = calloc(1, sizeof(*io));
+	if (!io)
+		return 1;
+
+	io->p     = p;
+	io->fd    = fd;
+	io->flags = flags;
+	io->cb    = cb;
+	io->arg   = arg;
+	LIST_INSERT_HEAD(&p->fds, io, link);
+
+	if (ctx && extra_io_start(io)) {
+		LIST_REMOVE(io, link);
+		free(io);
+		return 1;
+	}
+
 	return 0;
 }
 
+/**
+ * plugin_io_del - Stop watching a descriptor from plugin_io_add()
+ * @p:  Plugin
+ * @fd: Descriptor
+ *
+ * The descriptor is not closed, that is up to the plugin.
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero if @fd is not watched.
+ */
+int plugin_io_del(plugin_t *p, int fd)
+{
+	struct plugin_io *io;
+
+	if (!p) {
+		errno = EINVAL;
+		return 1;
+	}
+
+	LIST_FOREACH(io, &p->fds, link) {
+		if (io->fd != fd)
+			continue;
+
+		if (io->started)
+			uev_io_stop(&io->watcher);
+		LIST_REMOVE(io, link);
+		free(io);
+
+		return 0;
+	}
+
+	errno = ENOENT;
+	return 1;
+}
+
 /* Setup any I/O callbacks for plugins that use them */
 static int init_plugins(uev_ctx_t *ctx)
 {
@@ -295,7 +726,7 @@ static int load_one(char *path, char *name)
 	int noext;
 	char sofile[CMD_SIZE];
 	void *handle;
-	plugin_t *plugin;
+	plugin_t *plugin, *last;
 
 	if (!path || !fisdir(path) || !name) {
 		errno = EINVAL;
@@ -307,14 +738,16 @@ static int load_one(char *path, char *name)
 	snprintf(sofile, sizeof(sofile), "%s/%s%s", path, name, noext ? ".so" : "");
 
 	_d("Loading plugin %s ...", basename(sofile));
+	last = TAILQ_LAST(&plugins, plugin_head);
 	handle = dlopen(sofile, RTLD_LAZY | RTLD_LOCAL);
 	if (!handle) {
 		_e("Failed loading plugin %s: %s", sofile, dlerror());
 		return 1;
 	}
 
+	/* Registered by its constructor, when dlopen() ran it */
 	plugin = TAILQ_LAST(&plugins, plugin_head);
-	if (!plugin) {
+	if (!plugin || plugin == last) {
 		_e("Plugin %s failed to register, unloading from memory", sofile);
 		dlclose(handle);
 		return 1;
@@ -326,54 +759,36 @@ static int load_one(char *path, char *name)
 	return 0;
 }
 
-/**
- * check_plugin_depends - Check and load any plugins this one depends on.
- * @plugin: Plugin with possible depends to check
- *
- * Very simple dependency resolver, should actually load the plugin of
- * the correct .name, but currently loads a matching filename.
- *
- * Works, but only for now.  A better way might be to have a try_load()
- * that actually loads all plugins and checks their &plugin_t for the
- * correct .name.
- */
-static void check_plugin_depends(plugin_t *plugin)
+static int is_plugin(const struct dirent *entry)
 {
-	int i;
-
-	for (i = 0; i < PLUGIN_DEP_MAX && plugin->depends[i]; i++) {
-//		_d("Plugin %s depends on %s ...", plugin->name, plugin->depends[i]);
-		if (plugin_find(plugin->depends[i])) {
-//			_d("OK plugin %s was already loaded.", plugin->depends[i]);
-			continue;
-		}
+	const char *ext = strrchr(entry->d_name, '.');
 
-		load_one(plugpath, plugin->depends[i]);
-	}
+	return entry->d_name[0] != '.' && ext && !strcmp(ext, ".so");
 }
 
+/*
+ * Load all plugins in @path, in alphabetic order.  Dependencies are
+ * not loaded recursively, all plugins are in @path anyway, instead
+ * sort_plugins() orders them when all have been loaded.
+ */
 static int load_plugins(char *path)
 {
-	int fail = 0;
-	DIR *dp;
-	struct dirent *entry;
+	struct dirent **entry;
+	int i, num, fail = 0;
 
-	dp = opendir(path);
-	if (!dp) {
+	num = scandir(path, &entry, is_plugin, alphasort);
+	if (num < 0) {
 		_e("Failed, cannot open plugin directory %s: %s", path, strerror(errno));
 		return 1;
 	}
 	plugpath = path;
 
-	while ((entry = readdir(dp))) {
-		if (entry->d_name[0] == '.')
-			continue; /* Skip . and .. directories */
-
-		if (load_one(path, entry->d_name))
+	for (i = 0; i < num; i++) {
+		if (load_one(path, entry[i]->d_name))
 			fail++;
+		free(entry[i]);
 	}
-
-	closedir(dp);
+	free(entry);
 
 	return fail;
 }
@@ -385,12 +800,69 @@ static int load_plugins(char *path)
 }
 #endif	/* ENABLE_STATIC */
 
+/*
+ * Sort plugins in dependency order, the order hooks are called in.
+ * Plugins without any dependencies between them keep their relative
+ * load order, so the result is the same every boot.  Plugins in a
+ * dependency cycle are logged and placed last.
+ */
+static void sort_plugins(void)
+{
+	struct plugin_head sorted = TAILQ_HEAD_INITIALIZER(sorted);
+	plugin_t *p, *tmp, *dep;
+	int i, progress;
+
+	PLUGIN_ITERATOR(p, tmp) {
+		for (i = 0; i < PLUGIN_DEP_MAX && p->depends[i]; i++) {
+			TAILQ_FOREACH(dep, &plugins, link) {
+				if (depends_on(p, dep))
+					break;
+			}
+			if (!dep)
+				_e("Plugin %s depends on %s, which is not loaded", p->name, p->depends[i]);
+		}
+	}
+
+	do {
+		progress = 0;
+		PLUGIN_ITERATOR(p, tmp) {
+			TAILQ_FOREACH(dep, &plugins, link) {
+				if (dep != p && depends_on(p, dep))
+					break;
+			}
+			if (dep)
+				continue;
+
+			TAILQ_REMOVE(&plugins, p, link);
+			TAILQ_INSERT_TAIL(&sorted, p, link);
+			progress = 1;
+		}
+	} while (progress);
+
+	PLUGIN_ITERATOR(p, tmp) {
+		_e("Plugin %s is part of a dependency cycle", p->name);
+		TAILQ_REMOVE(&plugins, p, link);
+		TAILQ_INSERT_TAIL(&sorted, p, link);
+	}
+
+	while ((p = TAILQ_FIRST(&sorted))) {
+		TAILQ_REMOVE(&sorted, p, link);
+		TAILQ_INSERT_TAIL(&plugins, p, link);
+	}
+	hook_index();
+}
+
+/*
+ * Whatever loaded is sorted and initialized, one broken plugin must not
+ * take down all the others.  Returns the number of failures.
+ */
 int plugin_init(uev_ctx_t *ctx)
 {
-	int fail = 1;
+	int fail;
 
-	if (!load_plugins(PLUGIN_PATH))
-	    fail = init_plugins(ctx);
+	fail  = load_plugins(PLUGIN_PATH);
+	sort_plugins();
+	fail += init_plugins(ctx);
 
 	return fail;
 }
@@ -30,6 +30,7 @@
 #include "svc.h"
 
 #define PLUGIN_DEP_MAX  10
+#define PLUGIN_HOOK_TIMEOUT 30000	/* msec, default for async hooks */
 
 /*
  * Event flags for I/O plugins
@@ -40,6 +41,7 @@
 #define PLUGIN_IO_PRI   UEV_PRI
 #define PLUGIN_IO_HUP   UEV_HUP
 #define PLUGIN_IO_RDHUP UEV_RDHUP
+#define PLUGIN_IO_EDGE  UEV_EDGE	/* Edge triggered, implies persist */
 
 #define PLUGIN_INIT(x) static void __attribute__ ((constructor)) x(void)
 #define PLUGIN_EXIT(x) static void __attribute__ ((destructor))  x(void)
@@ -82,6 +84,9 @@
 								\
 	/* Shutdown hooks, runlevel [06] */			\
 	CHOOSE(HOOK_SHUTDOWN,        "hook/sys/shutdown"),	\
+								\
+	/* Added later, appended to keep the numbering */	\
+	CHOOSE(HOOK_WDOG_PRETIMEOUT, "nop"),			\
 	CHOOSE(HOOK_MAX_NUM,         "nop")			\
 }
 
@@ -96,6 +101,7 @@ typedef enum HOOK_TYPES hook_point_t;
  * @svc:  Service callback for a loaded &svc_t object
  * @hook: Hook callback definitions
  * @io:   I/O hook callback
+ * @fds:  Additional I/O callbacks, see plugin_io_add()
  *
  * To setup an &svc_t object callback for a service monitor the @name
  * must match the @svc_t @cmd exactly for them to "pair".
@@ -113,6 +119,27 @@ typedef enum HOOK_TYPES hook_point_t;
  * It is up to the external service plugin to track these events and
  * relay them to each @dynamic service plugins' callback.  I.e., to
  * all those with the dynamic flag set.
+ *
+ * A slow hook, e.g. one waiting for hardware, can be set @async.  Its
+ * callback is then called in a forked helper process, so only side
+ * effects outside of Finit remain, e.g. files or the system clock.
+ * The rest of the bootstrap continues meanwhile, but the hook's
+ * condition is not set until all callbacks for the hook are done.
+ * The optional @done callback is called by Finit when the helper has
+ * exited, with its exit status, or -1 if it was killed by @timeout.
+ * Hook callbacks are started in dependency order, a plugin's hook is
+ * not called until the hooks of all plugins in its @depends are done.
+ *
+ * By default the I/O watcher is stopped while the @io callback runs,
+ * and restarted after, since the callback may close and reopen its
+ * descriptor, e.g. a FIFO.  This costs two epoll_ctl() calls for each
+ * event, so a plugin with a high event rate can set @persist, or use
+ * %PLUGIN_IO_EDGE, to stay armed.  Such a callback must not close its
+ * descriptor, and with %PLUGIN_IO_EDGE it must read until %EAGAIN.
+ */
+/*
+ * Not a stable ABI, external plugins must be rebuilt when it changes,
+ * e.g., when fields are added to the hook entries.  See plugins.md
  */
 typedef struct plugin {
 	/* BSD sys/queue.h linked list node. */
@@ -132,6 +159,10 @@ typedef struct plugin {
 	struct {
 		void  *arg;      /* Optional argument to callback func. */
 		void (*cb)(void *arg);
+
+		int    async;    /* Call cb in a helper process */
+		int    timeout;  /* msec, default PLUGIN_HOOK_TIMEOUT */
+		void (*done)(void *arg, int status);
 	} hook[HOOK_MAX_NUM];
 
 	/* I/O Plugin */
@@ -139,8 +170,13 @@ typedef struct plugin {
 		int    fd, flags; /* 1:READ, 2:WRITE */
 		void  *arg;
 		void (*cb)(void *arg, int fd, int events);
+
+		int    persist;   /* Keep watcher armed during callback */
 	} io;
 
+	/* More I/O, from plugin_io_add(), always persistent */
+	LIST_HEAD(, plugin_io) fds;
+
 	/* Inetd Plugin, stdio used as client socket.
 	 * @type argument will be either SOCK_DGRAM or SOCK_STREAM */
 	struct {
@@ -152,6 +188,9 @@ typedef struct plugin {
 
 /* Public plugin API */
 int plugin_io_init    (plugin_t *plugin);
+int plugin_io_add     (plugin_t *plugin, int fd, int flags,
+		       void (*cb)(void *arg, int fd, int events), void *arg);
+int plugin_io_del     (plugin_t *plugin, int fd);
 
 int plugin_register   (plugin_t *plugin);
 int plugin_unregister (plugin_t *plugin);
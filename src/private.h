@@ -38,12 +38,13 @@ int       api_exit         (void);
 
 int       client           (int argc, char *argv[]);
 
-void      service_monitor  (pid_t lost);
+void      service_monitor  (pid_t lost, int status);
 
 const char *plugin_hook_str(hook_point_t no);
 int       plugin_exists    (hook_point_t no);
 void      plugin_run_hook  (hook_point_t no, void *arg);
 void      plugin_run_hooks (hook_point_t no);
+int       plugin_hook_lost (pid_t pid, int status);
 
 int       plugin_init      (uev_ctx_t *ctx);
 void      plugin_exit      (void);
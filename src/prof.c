@@ -0,0 +1,186 @@
+/* Event loop handler cost and latency, for debugging Finit itself
+ *
+ * Copyright (c) 2026  agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Every handler called from the event loop that may be costly, e.g.
+ * the API socket, SIGCHLD, or an I/O plugin, calls prof_now() first
+ * and prof_add() last.  Call count, total and max time, and a histogram
+ * of the time spent in each is kept in a small table, for 'initctl
+ * debug-stats'.  A periodic timer measures the event loop latency, the
+ * time from when it should have fired until it was called.
+ */
+
+#include "config.h"		/* Generated by configure script */
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <lite/lite.h>
+
+#include "finit.h"
+#include "log.h"
+#include "prof.h"
+
+#define LAG_PERIOD 1000		/* msec */
+
+static prof_t   table[PROF_MAX];
+static int      num;
+
+static uev_t    lag_timer;
+static uint64_t lag_due;
+
+/* Microseconds, from CLOCK_MONOTONIC */
+uint64_t prof_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static prof_t *prof_find(const char *kind, const char *name)
+{
+	prof_t *p;
+	int i;
+
+	if (!name)
+		name = "";
+
+	for (i = 0; i < num; i++) {
+		p = &table[i];
+		if (!strcmp(p->kind, kind) && !strcmp(p->name, name))
+			return p;
+	}
+
+	if (num >= PROF_MAX)
+		return NULL;
+
+	p = &table[num++];
+	strlcpy(p->kind, kind, sizeof(p->kind));
+	strlcpy(p->name, name, sizeof(p->name));
+
+	return p;
+}
+
+static void prof_record(prof_t *p, uint64_t usec)
+{
+	uint64_t lim = 10;
+	int i;
+
+	for (i = 0; i < PROF_BUCKETS - 1 && usec >= lim; i++)
+		lim *= 10;
+
+	p->hist[i]++;
+	p->calls++;
+	p->total_us += usec;
+	if (usec > p->max_us)
+		p->max_us = usec > UINT32_MAX ? UINT32_MAX : usec;
+}
+
+/**
+ * prof_add - Account for one call of an event loop handler
+ * @kind:  Type of handler, e.g. "api" or "plugin"
+ * @name:  Name of instance, e.g. plugin name, or %NULL
+ * @start: Value of prof_now() when the handler was called
+ */
+void prof_add(const char *kind, const char *name, uint64_t start)
+{
+	prof_t *p;
+
+	p = prof_find(kind, name);
+	if (p)
+		prof_record(p, prof_now() - start);
+}
+
+static void lag_cb(uev_t *w, void *arg, int events)
+{
+	const uint64_t period = LAG_PERIOD * 1000;
+	uint64_t now = prof_now();
+	prof_t *p;
+
+	p = prof_find("loop", "lag");
+	if (p)
+		prof_record(p, now > lag_due ? now - lag_due : 0);
+
+	/* Expirations missed while blocked are coalesced into one */
+	if (now >= lag_due)
+		lag_due += period * ((now - lag_due) / period + 1);
+}
+
+/**
+ * prof_init - Start measuring event loop latency
+ * @ctx: The Finit event loop
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero on error.
+ */
+int prof_init(uev_ctx_t *ctx)
+{
+	lag_due = prof_now() + LAG_PERIOD * 1000;
+
+	return uev_timer_init(ctx, &lag_timer, lag_cb, NULL, LAG_PERIOD, LAG_PERIOD);
+}
+
+/**
+ * prof_send - Send all handler stats to initctl
+ * @sd:    Client socket
+ * @reset: Clear all counters after sending
+ *
+ * The number of records, an int, is sent first, followed by the records.
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero on error.
+ */
+int prof_send(int sd, int reset)
+{
+	size_t len = num * sizeof(prof_t);
+	int i;
+
+	if (write(sd, &num, sizeof(num)) != sizeof(num))
+		return 1;
+	if (len && write(sd, table, len) != (ssize_t)len)
+		return 1;
+
+	if (!reset)
+		return 0;
+
+	/* Keep the records, only clear the counters */
+	for (i = 0; i < num; i++) {
+		prof_t *p = &table[i];
+
+		p->calls    = 0;
+		p->max_us   = 0;
+		p->total_us = 0;
+		memset(p->hist, 0, sizeof(p->hist));
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,59 @@
+/* Event loop handler cost and latency, for debugging Finit itself
+ *
+ * Copyright (c) 2026  agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FINIT_PROF_H_
+#define FINIT_PROF_H_
+
+#include <stdint.h>
+#include <uev/uev.h>
+
+#define PROF_MAX     64		/* Max number of handlers tracked */
+#define PROF_BUCKETS 8		/* <10us, <100us, <1ms, ... <10s, >=10s */
+
+/*
+ * Cost of an event loop handler, or the lag of the event loop itself.
+ * Sent as-is to initctl, see INIT_CMD_DEBUG_STATS.
+ */
+typedef struct {
+	char     kind[12];		/* api, sigchld, conf, plugin, ... */
+	char     name[20];		/* Plugin name, or empty */
+	uint32_t calls;
+	uint32_t max_us;
+	uint64_t total_us;
+	uint32_t hist[PROF_BUCKETS];
+} prof_t;
+
+uint64_t prof_now   (void);
+void     prof_add   (const char *kind, const char *name, uint64_t start);
+
+int      prof_init  (uev_ctx_t *ctx);
+int      prof_send  (int sd, int reset);
+
+#endif /* FINIT_PROF_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -32,13 +32,16 @@
 #include <net/if.h>
 #include <lite/lite.h>
 
+#include "cgroup.h"
 #include "conf.h"
 #include "cond.h"
 #include "finit.h"
 #include "helpers.h"
 #include "inetd.h"
 #include "pid.h"
+#include "pidfd.h"
 #include "private.h"
+#include "prof.h"
 #include "sig.h"
 #include "service.h"
 #include "sm.h"
@@ -49,6 +52,9 @@
 #define RESPAWN_MAX    10	/* Prevent endless respawn of faulty services. */
 
 static void svc_set_state(svc_t *svc, svc_state_t new);
+static void service_collect(svc_t *svc, int status);
+static void heartbeat_start(svc_t *svc);
+static void heartbeat_stop(svc_t *svc);
 
 /**
  * service_timeout_cb - libuev callback wrapper for service timeouts
@@ -61,10 +67,13 @@ static void svc_set_state(svc_t *svc, svc_state_t new);
 static void service_timeout_cb(uev_t *w, void *arg, int events)
 {
 	svc_t *svc = arg;
+	uint64_t t0 = prof_now();
 
 	/* Ignore any UEV_ERROR, we're a one-shot cb so just run it. */
 	if (svc->timer_cb)
 		svc->timer_cb(svc);
+
+	prof_add("timer", NULL, t0);
 }
 
 /**
@@ -122,6 +131,98 @@ static void redirect_null(void)
 	}
 }
 
+/*
+ * Services run in their own process group, and cgroup if enabled, so
+ * any processes they fork can be stopped along with them.  Connections
+ * of an inetd service share a cgroup, so only their group is used.
+ */
+static int tree_kill(svc_t *svc, int signo)
+{
+	if (!svc_is_inetd_conn(svc) && !cgroup_signal(svc, signo))
+		return 0;
+
+	if (svc->pgid > 1 && !kill(-svc->pgid, signo))
+		return 0;
+
+	if (svc->pid > 1)
+		return kill(svc->pid, signo);
+
+	return errno = ESRCH;
+}
+
+/* Stops tracking the process tree when it's empty */
+static int tree_alive(svc_t *svc)
+{
+	int alive = -1;
+
+	if (svc->pgid <= 1)
+		return 0;
+
+	if (!svc_is_inetd_conn(svc))
+		alive = cgroup_populated(svc);
+	if (alive < 0)
+		alive = !kill(-svc->pgid, 0);
+
+	if (!alive)
+		svc->pgid = 0;
+
+	return alive;
+}
+
+/*
+ * Update runtime statistics when the main PID of @svc has exited with
+ * @status.  A daemon is never expected to exit, a task only with exit
+ * status zero, unless we asked it to stop.
+ */
+static void service_account(svc_t *svc, int status)
+{
+	svc_stats_t *st = &svc->stats;
+	int code;
+
+	if (svc->start_time)
+		st->uptime += jiffies() - svc->start_time;
+	st->fork_ms = 0;
+
+	if (status == -1) {
+		st->crashes++;
+		return;
+	}
+
+	if (WIFSIGNALED(status)) {
+		st->signals++;
+		st->last_signal = WTERMSIG(status);
+	} else {
+		code = WEXITSTATUS(status);
+		if (code >= MAX_EXIT_CODES)
+			code = MAX_EXIT_CODES - 1;
+		st->exits[code]++;
+	}
+
+	if (svc->state == SVC_STOPPING_STATE)
+		return;
+
+	if (svc_is_daemon(svc) || svc_is_redir(svc) || !WIFEXITED(status) || WEXITSTATUS(status))
+		st->crashes++;
+}
+
+/* Exit of service started with pidfd_fork(), no need to look it up */
+static void service_exit_cb(uev_t *w, void *arg, int events)
+{
+	svc_t *svc = (svc_t *)arg;
+	uint64_t t0 = prof_now();
+	int status = 0;
+
+	if (pidfd_wait(w, svc->pid, &status, WNOHANG) <= 0)
+		return;
+
+	if (fexist(SYNC_SHUTDOWN))
+		return;
+
+	plugin_run_hook(HOOK_SVC_LOST, (void *)(uintptr_t)svc->pid);
+	service_collect(svc, status);
+	prof_add("pidfd", NULL, t0);
+}
+
 static int is_norespawn(void)
 {
 	return  sig_stopped()            ||
@@ -141,45 +242,58 @@ static int service_start(svc_t *svc)
 	int i, result = 0, do_progress = 1;
 	pid_t pid;
 	sigset_t nmask, omask;
+	svc_conf_t *conf;
 
 	if (!svc)
 		return 1;
+	conf = svc->conf;
 
 	/* Ignore if finit is SIGSTOP'ed */
 	if (is_norespawn())
 		return 1;
 
 	/* Don't try and start service if it doesn't exist. */
-	if (!whichp(svc->cmd) && !svc->inetd.cmd) {
+	if (!whichp(svc->cmd) && !svc->inetd.cmd && !svc->inetd.redir) {
 		print(1, "Service %s does not exist!", svc->cmd);
 		svc_missing(svc);
 		return 1;
 	}
 
 #ifdef INETD_ENABLED
-	if (svc_is_inetd(svc))
-		return inetd_start(&svc->inetd);
+	/* Redirect services are started as a helper owning the socket(s) */
+	if (svc_is_inetd(svc)) {
+		result = inetd_start(&svc->inetd);
+		if (result || !svc_is_redir(svc))
+			return result;
+	}
 #endif
 
-	if (!svc->desc[0])
+	if (!svc_desc(svc)[0])
 		do_progress = 0;
 
 	if (do_progress) {
 		if (svc_is_daemon(svc))
-			print_desc("Starting ", svc->desc);
+			print_desc("Starting ", svc_desc(svc));
 		else
-			print_desc("", svc->desc);
+			print_desc("", svc_desc(svc));
 	}
 
 	/* Declare we're waiting for svc to create its pidfile */
 	svc_starting(svc);
 
+	/* Own cgroup, or shared with other inetd connections */
+	cgroup_service(svc);
+
 	/* Block SIGCHLD while forking.  */
 	sigemptyset(&nmask);
 	sigaddset(&nmask, SIGCHLD);
 	sigprocmask(SIG_BLOCK, &nmask, &omask);
 
-	pid = fork();
+	/* A run is collected by complete(), below */
+	if (SVC_TYPE_RUN == svc->type)
+		pid = fork();
+	else
+		pid = pidfd_fork(&svc->pidfd, service_exit_cb, svc);
 	if (pid == 0) {
 		int status;
 		char *home = NULL;
@@ -187,14 +301,19 @@ static int service_start(svc_t *svc)
 		int uid = 0; /* XXX: Fix better warning that dropprivs is disabled. */
 		int gid = 0;
 #else
-		int uid = getuser(svc->username, &home);
-		int gid = getgroup(svc->group);
+		int uid = getuser(svc_conf_str(conf, conf->username), &home);
+		int gid = getgroup(svc_conf_str(conf, conf->group));
 #endif
 		char *args[MAX_NUM_SVC_ARGS];
+		int logging = conf->log.enabled;
+
+		/* Before anything else, so all our children are included */
+		cgroup_enter(svc);
+		setpgid(0, 0);
 
 		/* Set configured limits */
 		for (int i = 0; i < RLIMIT_NLIMITS; i++) {
-			if (setrlimit(i, &svc->rlimit[i]) == -1)
+			if (setrlimit(i, &conf->rlimit[i]) == -1)
 				logit(LOG_WARNING,
 				      "%s: rlimit: Failed setting %s",
 				      svc->cmd, rlim2str(i));
@@ -217,8 +336,8 @@ static int service_start(svc_t *svc)
 		}
 
 		/* Serve copy of args to process in case it modifies them. */
-		for (i = 0; i < (MAX_NUM_SVC_ARGS - 1) && svc->args[i][0] != 0; i++)
-			args[i] = svc->args[i];
+		for (i = 0; i < (MAX_NUM_SVC_ARGS - 1) && i < conf->argc; i++)
+			args[i] = svc_arg(svc, i);
 		args[i] = NULL;
 
 		/* Redirect inetd socket to stdin for connection */
@@ -231,10 +350,10 @@ static int service_start(svc_t *svc)
 		} else
 #endif
 
-		if (svc->log.enabled) {
+		if (logging) {
 			int fd;
 
-			if (svc->log.null) {
+			if (conf->log.null) {
 				redirect_null();
 				goto logit_done;
 			}
@@ -245,12 +364,12 @@ static int service_start(svc_t *svc)
 			 */
 			fd = posix_openpt(O_RDWR);
 			if (fd == -1) {
-				svc->log.enabled = 0;
+				logging = 0;
 				goto logit_done;
 			}
 			if (grantpt(fd) == -1 || unlockpt(fd) == -1) {
 				close(fd);
-				svc->log.enabled = 0;
+				logging = 0;
 				goto logit_done;
 			}
 
@@ -271,20 +390,21 @@ static int service_start(svc_t *svc)
 				/* Reset signals */
 				sig_unblock();
 
-				if (svc->log.file[0] == '/') {
+				if (svc_conf_str(conf, conf->log.file)[0] == '/') {
 					char sz[20], num[3];
 
 					snprintf(sz, sizeof(sz), "%d", logfile_size_max);
 					snprintf(num, sizeof(num), "%d", logfile_count_max);
 
-					execlp("logit", "logit", "-f", svc->log.file, "-n", sz, "-r", num, NULL);
+					execlp("logit", "logit", "-f", svc_conf_str(conf, conf->log.file),
+					       "-n", sz, "-r", num, NULL);
 					_exit(0);
 				}
 
-				if (svc->log.ident[0])
-					tag = svc->log.ident;
-				if (svc->log.prio[0])
-					prio = svc->log.prio;
+				if (conf->log.ident)
+					tag = svc_conf_str(conf, conf->log.ident);
+				if (conf->log.prio)
+					prio = svc_conf_str(conf, conf->log.prio);
 
 				execlp("logit", "logit", "-t", tag, "-p", prio, NULL);
 				_exit(0);
@@ -313,6 +433,10 @@ static int service_start(svc_t *svc)
 
 		if (svc->inetd.cmd)
 			status = svc->inetd.cmd(svc->inetd.type);
+#ifdef INETD_ENABLED
+		else if (svc_is_redir(svc))
+			status = inetd_redir(&svc->inetd);
+#endif
 		else if (svc_is_runtask(svc))
 			status = exec_runtask(svc->cmd, args);
 		else
@@ -327,16 +451,16 @@ static int service_start(svc_t *svc)
 			}
 		} else
 #endif
-		if (svc->log.enabled && !svc->log.null)
+		if (logging && !conf->log.null)
 			waitpid(pid, NULL, 0);
 		_exit(status);
 	} else if (log_is_debug()) {
 		char buf[CMD_SIZE] = "";
 
-		for (i = 0; i < (MAX_NUM_SVC_ARGS - 1) && svc->args[i][0] != 0; i++) {
+		for (i = 0; i < (MAX_NUM_SVC_ARGS - 1) && i < conf->argc; i++) {
 			char arg[MAX_ARG_LEN];
 
-			snprintf(arg, sizeof(arg), "%s ", svc->args[i]);
+			snprintf(arg, sizeof(arg), "%s ", svc_arg(svc, i));
 			if (strlen(arg) < (sizeof(buf) - strlen(buf)))
 				strcat(buf, arg);
 		}
@@ -345,22 +469,39 @@ static int service_start(svc_t *svc)
 
 	svc->pid = pid;
 	svc->start_time = jiffies();
+	if (pid > 0) {
+		svc->stats.starts++;
+		svc->stats.fork_ms = now_ms();
+	}
+
+	/* Either of us may be first, see setpgid(2) */
+	if (pid > 0) {
+		setpgid(pid, pid);
+		svc->pgid = pid;
+	}
 
 #ifdef INETD_ENABLED
 	if (svc_is_inetd_conn(svc) && svc->inetd.type == SOCK_STREAM)
 		close(svc->stdin_fd);
+	if (svc_is_redir(svc))
+		inetd_stop(&svc->inetd);
 #endif
 
 	if (SVC_TYPE_RUN == svc->type) {
-		result = WEXITSTATUS(complete(svc->cmd, pid));
+		svc->status = complete(svc->cmd, pid);
+		service_account(svc, svc->status);
+		result = WEXITSTATUS(svc->status);
+		svc->pgid = 0;	/* Any leftovers are on purpose */
 		if (!svc_clean_bootstrap(svc)) {
 			svc->start_time = svc->pid = 0;
 			svc_set_state(svc, SVC_STOPPING_STATE);
 		}
 	}
 
-	if (svc_is_daemon(svc))
+	if (svc_is_daemon(svc) && pid > 0) {
 		pid_file_create(svc);
+		heartbeat_start(svc);
+	}
 
 	sigprocmask(SIG_SETMASK, &omask, NULL);
 	if (do_progress)
@@ -377,27 +518,46 @@ static int service_start(svc_t *svc)
 	return result;
 }
 
+/*
+ * Processes in uninterruptible sleep may never exit, don't wait for
+ * them forever, only for the main PID.
+ */
+static void service_abandon(svc_t *svc)
+{
+	service_timeout_cancel(svc);
+
+	if (tree_alive(svc)) {
+		logit(LOG_WARNING, "%s: processes left after SIGKILL, giving up on them.", svc->cmd);
+		svc->pgid = 0;
+	}
+
+	service_step(svc);
+	sm_step(&sm);
+}
+
 /**
  * service_kill - Forcefully terminate a service
  * @param svc  Service to kill
  *
- * Called when a service refuses to terminate gracefully.
+ * Called when a service, or any process it has forked, refuses to
+ * terminate gracefully.
  */
 static void service_kill(svc_t *svc)
 {
 	service_timeout_cancel(svc);
 
-	if (svc->pid <= 1) {
+	if (svc->pid <= 1 && !tree_alive(svc)) {
 		/* Avoid killing ourselves or all processes ... */
 		_d("%s: Aborting SIGKILL, already terminated.", svc->cmd);
 		return;
 	}
 
-	_d("%s: Sending SIGKILL to pid:%d", pid_get_name(svc->pid, NULL, 0), svc->pid);
+	_d("%s: Sending SIGKILL to pid:%d pgid:%d", svc->cmd, svc->pid, svc->pgid);
 	if (runlevel != 1)
-		print_desc("Killing ", svc->desc);
+		print_desc("Killing ", svc_desc(svc));
 
-	kill(svc->pid, SIGKILL);
+	tree_kill(svc, SIGKILL);
+	service_timeout_after(svc, 3000, service_abandon);
 
 	/* Let SIGKILLs stand out, show result as [WARN] */
 	if (runlevel != 1)
@@ -419,11 +579,11 @@ static int service_stop(svc_t *svc)
 		return 1;
 
 #ifdef INETD_ENABLED
-	if (svc_is_inetd(svc)) {
+	if (svc_is_inetd(svc) && !svc_is_redir(svc)) {
 		int do_progress = runlevel != 1 && !svc_is_busy(svc);
 
 		if (do_progress)
-			print_desc("Stopping ", svc->desc);
+			print_desc("Stopping ", svc_desc(svc));
 
 		inetd_stop(&svc->inetd);
 
@@ -439,13 +599,13 @@ static int service_stop(svc_t *svc)
 	if (svc->pid <= 1)
 		return 1;
 
-	_d("Sending SIGTERM to pid:%d name:%s", svc->pid, pid_get_name(svc->pid, NULL, 0));
+	_d("Sending SIGTERM to pid:%d pgid:%d name:%s", svc->pid, svc->pgid, pid_get_name(svc->pid, NULL, 0));
 	svc_set_state(svc, SVC_STOPPING_STATE);
 
 	if (runlevel != 1)
-		print_desc("Stopping ", svc->desc);
+		print_desc("Stopping ", svc_desc(svc));
 
-	res = kill(svc->pid, SIGTERM);
+	res = tree_kill(svc, SIGTERM);
 
 	if (runlevel != 1)
 		print_result(res);
@@ -453,6 +613,80 @@ static int service_stop(svc_t *svc)
 	return res;
 }
 
+/*
+ * A service with heartbeat:SEC must touch its PID file at least every
+ * SEC seconds, otherwise it is considered hung.  It is then stopped,
+ * but left in running state, so it is collected and restarted just
+ * like a crashed service, see service_retry().
+ */
+static void heartbeat_cb(uev_t *w, void *arg, int events)
+{
+	svc_t *svc = arg;
+
+	heartbeat_stop(svc);
+	if (!svc->conf->heartbeat || svc->pid <= 1)
+		return;
+
+	/* SIGSTOPed while its conditions are in flux, start over */
+	if (svc->state == SVC_WAITING_STATE) {
+		heartbeat_start(svc);
+		return;
+	}
+	if (svc->state != SVC_RUNNING_STATE)
+		return;
+
+	logit(LOG_WARNING, "%s[%d] missed its heartbeat, no sign of life in %d sec, restarting.",
+	      svc->cmd, svc->pid, svc->conf->heartbeat);
+
+	service_timeout_cancel(svc);
+	tree_kill(svc, SIGTERM);
+	service_timeout_after(svc, 3000, service_kill);
+}
+
+static void heartbeat_start(svc_t *svc)
+{
+	int sec = svc->conf->heartbeat;
+
+	if (!sec || svc->hb_armed)
+		return;
+
+	if (uev_timer_init(ctx, &svc->hb_timer, heartbeat_cb, svc, sec * 1000, 0)) {
+		_e("%s: failed starting heartbeat timer", svc->cmd);
+		return;
+	}
+	svc->hb_armed = 1;
+}
+
+static void heartbeat_stop(svc_t *svc)
+{
+	if (!svc->hb_armed)
+		return;
+
+	uev_timer_stop(&svc->hb_timer);
+	svc->hb_armed = 0;
+}
+
+/**
+ * service_heartbeat - Service has shown a sign of life
+ * @svc: Service that touched its PID file
+ *
+ * Called by the pidfile plugin.  Moves the deadline of a service with
+ * a heartbeat, a no-op for all other services.
+ */
+void service_heartbeat(svc_t *svc)
+{
+	if (!svc || !svc->conf->heartbeat || svc->pid <= 1)
+		return;
+
+	/* E.g., heartbeat added by initctl reload */
+	if (!svc->hb_armed) {
+		heartbeat_start(svc);
+		return;
+	}
+
+	uev_timer_set(&svc->hb_timer, svc->conf->heartbeat * 1000, 0);
+}
+
 /**
  * service_restart - Restart a service by sending %SIGHUP
  * @svc: Service to reload
@@ -481,8 +715,8 @@ static int service_restart(svc_t *svc)
 	}
 
 	_d("Sending SIGHUP to PID %d", svc->pid);
-	if (svc->desc[0])
-		print_desc("Restarting ", svc->desc);
+	if (svc_desc(svc)[0])
+		print_desc("Restarting ", svc_desc(svc));
 
 	rc = kill(svc->pid, SIGHUP);
 
@@ -495,7 +729,7 @@ static int service_restart(svc_t *svc)
 		touch(pid_file(svc));
 	}
 
-	if (svc->desc[0])
+	if (svc_desc(svc)[0])
 		print_result(rc);
 
 	return rc;
@@ -536,30 +770,53 @@ void service_runlevel(int newlevel)
 /*
  * log:/path/to/logfile,priority:facility.level,tag:ident
  */
-static void parse_log(svc_t *svc, char *arg)
+static void parse_log(svc_conf_buf_t *buf, char *arg)
 {
 	char *tok;
 
 	tok = strtok(arg, ":, ");
 	while (tok) {
 		if (!strcmp(tok, "log"))
-			svc->log.enabled = 1;
+			buf->log.enabled = 1;
 		else if (!strcmp(tok, "null") || !strcmp(tok, "/dev/null"))
-			svc->log.null = 1;
+			buf->log.null = 1;
 		else if (tok[0] == '/')
-			strlcpy(svc->log.file, tok, sizeof(svc->log.file));
+			strlcpy(buf->log.file, tok, sizeof(buf->log.file));
 		else if (!strcmp(tok, "priority") || !strcmp(tok, "prio"))
-			strlcpy(svc->log.prio, strtok(NULL, ","), sizeof(svc->log.prio));
+			strlcpy(buf->log.prio, strtok(NULL, ","), sizeof(buf->log.prio));
 		else if (!strcmp(tok, "tag") || !strcmp(tok, "identity") || !strcmp(tok, "ident"))
-			strlcpy(svc->log.ident, strtok(NULL, ","), sizeof(svc->log.ident));
+			strlcpy(buf->log.ident, strtok(NULL, ","), sizeof(buf->log.ident));
 
 		tok = strtok(NULL, ":=, ");
 	}
 }
 
+#ifdef INETD_ENABLED
+/* Set up, or on reload clear, redirect mode of inetd @svc */
+static int inetd_redir_setup(svc_t *svc, int redir, int forking)
+{
+	if (!redir) {
+		if (svc->inetd.redir) {
+			svc->inetd.redir   = 0;
+			svc->inetd.forking = forking;
+		}
+		return 0;
+	}
+
+	if (svc->inetd.builtin || inetd_set_redir(&svc->inetd, svc->cmd)) {
+		_e("Invalid backend ADDR:PORT for redir %s, skipping ...", svc->cmd);
+		return errno = EINVAL;
+	}
+	_d("Inetd %s redirected to backend %s", svc->inetd.name, svc->cmd);
+
+	return 0;
+}
+#endif
+
 /**
  * service_register - Register service, task or run commands
- * @type:   %SVC_TYPE_SERVICE(0), %SVC_TYPE_TASK(1), %SVC_TYPE_RUN(2)
+ * @type:   %SVC_TYPE_SERVICE(0), %SVC_TYPE_TASK(1), %SVC_TYPE_RUN(2),
+ *          %SVC_TYPE_INETD, or %SVC_TYPE_REDIR for an inetd redirect
  * @cfg:    Configuration, complete command, with -- for description text
  * @rlimit: Limits for this service/task/run/inetd, may be global limits
  * @file:   The file name service was loaded from
@@ -577,6 +834,8 @@ static void parse_log(svc_t *svc, char *arg)
  *     task @username [!0-6,S] /path/to/task arg              -- Description
  *     run  @username [!0-6,S] /path/to/cmd arg               -- Description
  *     inetd tcp/ssh nowait [2345] @root:root /sbin/sshd -i   -- Description
+ *     inetd tcp/ssh nowait max:32 perip:4 rate:10/20 /sbin/sshd -i
+ *     redir http/tcp@eth0 nowait [2345] 127.0.0.1:8080
  *
  * If the username is left out the command is started as root.  The []
  * brackets denote the allowed runlevels, if left out the default for a
@@ -615,12 +874,22 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 	int id = -1;
 #ifdef INETD_ENABLED
 	int forking = 0;
+	int redir = 0;
 #endif
 	int levels = 0;
+	int critical = 0;
+	int heartbeat = 0;
 	char *line;
 	char *username = NULL, *log = NULL, *pid = NULL;
 	char *service = NULL, *proto = NULL, *ifaces = NULL;
 	char *cmd, *desc, *runlevels = NULL, *cond = NULL;
+	char *cgroups[8];
+	int ncgroups = 0;
+#ifdef INETD_ENABLED
+	char *opts[8];
+	int nopts = 0;
+#endif
+	svc_conf_buf_t buf;
 	svc_t *svc;
 	plugin_t *plugin = NULL;
 
@@ -629,6 +898,14 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 		return errno = EINVAL;
 	}
 
+#ifdef INETD_ENABLED
+	/* Same as inetd, but the command is a backend ADDR:PORT */
+	if (type == SVC_TYPE_REDIR) {
+		type  = SVC_TYPE_INETD;
+		redir = 1;
+	}
+#endif
+
 	line = strdup(cfg);
 	if (!line)
 		return 1;
@@ -673,7 +950,28 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 			forking = 1;
 		else if (!strncasecmp(cmd, "wait", 4))
 			forking = 0;
+		else if (type == SVC_TYPE_INETD && inetd_is_opt(cmd)) {
+			if (nopts < (int)NELEMS(opts))
+				opts[nopts++] = cmd;
+		}
 #endif
+		else if (!strncasecmp(cmd, "cgroup.", 7)) {
+			if (ncgroups < (int)NELEMS(cgroups))
+				cgroups[ncgroups++] = &cmd[7];
+		}
+		else if (!strcasecmp(cmd, "critical"))
+			critical = 1;
+		else if (!strncasecmp(cmd, "heartbeat:", 10)) {
+			const char *errstr;
+
+			heartbeat = strtonum(&cmd[10], 1, 3600, &errstr);
+			if (errstr)
+				_e("Invalid heartbeat, %s: %s", errstr, cmd);
+			else if (!plugin_find("pidfile")) {
+				_e("Ignoring %s, requires the pidfile plugin", cmd);
+				heartbeat = 0;
+			}
+		}
 		else if (!strncasecmp(cmd, "log", 3))
 			log = cmd;
 		else if (!strncasecmp(cmd, "pid", 3))
@@ -731,8 +1029,15 @@ int service_register(int type, char *cfg, struct rlimit rlimit[], char *file)
 
 		/* Check if known inetd, then add ifnames for filtering only. */
 		svc = inetd_find_svc(cmd, service, proto);
-		if (svc)
+		if (svc) {
+			/* Left marked for removal by the reload on error */
+			if (inetd_redir_setup(svc, redir, forking)) {
+				free(line);
+				return errno;
+			}
+			svc_conf_get(svc, &buf);
 			goto inetd_setup;
+		}
 
 		if (id <= 0)
 			id = svc_next_id(cmd);
@@ -764,20 +1069,31 @@ recreate:
 	}
 #endif
 
-	/* Always clear svc PID file, for now.  See TODO */
-	svc->pidfile[0] = 0;
+	/* Always start from scratch, e.g. clear PID file.  See TODO */
+	svc_conf_init(&buf, svc->cmd);
+
+	buf.critical  = critical;
+	buf.heartbeat = heartbeat;
+
 	/* Decode any optional pid:/optional/path/to/file.pid */
-	if (pid && svc_is_daemon(svc) && pid_file_parse(svc, pid))
+	if (pid && svc_is_daemon(svc) && pid_file_parse(svc, &buf, pid))
 		_e("Invalid 'pid' argument to service: %s", pid);
 
+	/* Finit touches PID files it manages itself, those are no sign of life */
+	if (buf.heartbeat && buf.pidfile[0] && buf.pidfile[0] != '!') {
+		_e("%s: heartbeat requires a PID file not managed by Finit, e.g. pid:!%s",
+		   svc->cmd, buf.pidfile);
+		buf.heartbeat = 0;
+	}
+
 	if (username) {
 		char *ptr = strchr(username, ':');
 
 		if (ptr) {
 			*ptr++ = 0;
-			strlcpy(svc->group, ptr, sizeof(svc->group));
+			strlcpy(buf.group, ptr, sizeof(buf.group));
 		}
-		strlcpy(svc->username, username, sizeof(svc->username));
+		strlcpy(buf.username, username, sizeof(buf.username));
 	}
 
 	if (plugin) {
@@ -785,21 +1101,34 @@ recreate:
 		svc->inetd.cmd = plugin->inetd.cmd;
 		svc->inetd.builtin = 1;
 	} else {
-		strlcpy(svc->args[i++], cmd, sizeof(svc->args[0]));
-		while ((cmd = strtok(NULL, " ")))
-			strlcpy(svc->args[i++], cmd, sizeof(svc->args[0]));
-		svc->args[i][0] = 0;
+		strlcpy(buf.args[i++], cmd, sizeof(buf.args[0]));
+		while ((cmd = strtok(NULL, " ")) && i < MAX_NUM_SVC_ARGS)
+			strlcpy(buf.args[i++], cmd, sizeof(buf.args[0]));
 	}
 
 	svc->runlevels = levels;
 	_d("Service %s runlevel 0x%2x", svc->cmd, svc->runlevels);
 
-	conf_parse_cond(svc, cond);
+	conf_parse_cond(svc, &buf, cond);
 
 	if (log)
-		parse_log(svc, log);
+		parse_log(&buf, log);
 	if (desc)
-		strlcpy(svc->desc, desc, sizeof(svc->desc));
+		strlcpy(buf.desc, desc, sizeof(buf.desc));
+
+	/* cgroup.FILE:VALUE, e.g. cgroup.memory.max:64M */
+	for (i = 0; i < ncgroups; i++) {
+		char *val = strchr(cgroups[i], ':');
+
+		if (!val || val == cgroups[i] || !val[1] || strchr(cgroups[i], '/')) {
+			_e("Invalid cgroup setting for %s: %s", svc->cmd, cgroups[i]);
+			continue;
+		}
+
+		if (buf.cgroup[0])
+			strlcat(buf.cgroup, " ", sizeof(buf.cgroup));
+		strlcat(buf.cgroup, cgroups[i], sizeof(buf.cgroup));
+	}
 
 #ifdef INETD_ENABLED
 	if (svc_is_inetd(svc)) {
@@ -814,9 +1143,21 @@ recreate:
 			return svc_del(svc);
 		}
 
+		if (inetd_redir_setup(svc, redir, forking)) {
+			free(line);
+			svc_del(svc);
+			return errno = EINVAL;
+		}
+
 	inetd_setup:
 		inetd_flush(&svc->inetd);
 
+		inetd_flush_opts(&svc->inetd);
+		for (i = 0; i < nopts; i++) {
+			if (inetd_set_opt(&svc->inetd, opts[i]))
+				_e("Invalid inetd option for %s: %s", service, opts[i]);
+		}
+
 		if (!ifaces) {
 			_d("No specific iface listed for %s, allowing ANY", service);
 			inetd_allow(&svc->inetd, NULL);
@@ -831,7 +1172,31 @@ recreate:
 	}
 #endif
 	/* Set configured limits */
-	memcpy(svc->rlimit, rlimit, sizeof(svc->rlimit));
+	memcpy(buf.rlimit, rlimit, sizeof(buf.rlimit));
+
+	/* Pack, unchanged configurations are shared with the old one */
+	heartbeat = svc->conf ? svc->conf->heartbeat : 0;
+	if (svc_conf_set(svc, &buf))
+		_e("Failed setting configuration of %s: %s", svc->cmd, strerror(errno));
+
+	/* Heartbeat dropped or changed by reload, stop or re-arm timer */
+	if (svc->hb_armed && svc->conf->heartbeat != heartbeat) {
+		if (svc->conf->heartbeat)
+			uev_timer_set(&svc->hb_timer, svc->conf->heartbeat * 1000, 0);
+		else
+			heartbeat_stop(svc);
+	}
+
+	/* Remember origin, for incremental reload */
+	if (file) {
+		char *name = basename(file);
+
+		if (!svc->file || strcmp(svc->file, name)) {
+			if (svc->file)
+				free(svc->file);
+			svc->file = strdup(name);
+		}
+	}
 
 	/* New, recently modified or unchanged ... used on reload. */
 	if (file && conf_changed(file))
@@ -870,6 +1235,11 @@ void service_unregister(svc_t *svc)
 	if (!svc_is_inetd_conn(svc))
 		service_stop(svc);
 
+#ifdef INETD_ENABLED
+	if (svc_is_inetd_conn(svc))
+		inetd_release(&svc->inetd);
+#endif
+
 	if (svc_is_inetd(svc)) {
 		if (svc_is_busy(svc->inetd.svc)) {
 			svc_unblock(svc->inetd.svc);
@@ -879,10 +1249,24 @@ void service_unregister(svc_t *svc)
 		inetd_del(&svc->inetd);
 	}
 
+	heartbeat_stop(svc);
+	cgroup_remove(svc);
 	svc_del(svc);
 }
 
-void service_monitor(pid_t lost)
+static int tree_step(svc_t *svc)
+{
+	if (svc->state == SVC_STOPPING_STATE && !svc->pid)
+		service_step(svc);
+
+	return 0;
+}
+
+/*
+ * Called by the SIGCHLD handler for all processes not watched by a
+ * pidfd from pidfd_fork(), e.g., all on kernels without pidfd support.
+ */
+void service_monitor(pid_t lost, int status)
 {
 	svc_t *svc;
 
@@ -892,15 +1276,37 @@ void service_monitor(pid_t lost)
 	if (tty_respawn(lost))
 		return;
 
+	if (run_parts_lost(lost, status))
+		return;
+
+	if (plugin_hook_lost(lost, status))
+		return;
+
 	plugin_run_hook(HOOK_SVC_LOST, (void *)(uintptr_t)lost);
 
 	svc = svc_find_by_pid(lost);
 	if (!svc) {
 		_d("collected unknown PID %d", lost);
+
+		/* Orphan, possibly the last of a tree we wait for */
+		svc_foreach(tree_step);
+		sm_step(&sm);
 		return;
 	}
 
-	_d("collected %s(%d)", svc->cmd, lost);
+	service_collect(svc, status);
+}
+
+/* The main PID of @svc has exited with @status, update books */
+static void service_collect(svc_t *svc, int status)
+{
+	pid_t lost = svc->pid;
+
+	svc->status = status;
+	if (WIFSIGNALED(status))
+		_d("collected %s(%d), killed by signal %d", svc->cmd, lost, WTERMSIG(status));
+	else
+		_d("collected %s(%d), exit status %d", svc->cmd, lost, WEXITSTATUS(status));
 
 	/* Try removing PID file (in case service does not clean up after itself) */
 	if (svc_is_daemon(svc)) {
@@ -912,7 +1318,20 @@ void service_monitor(pid_t lost)
 	}
 
 	/* No longer running, update books. */
+	service_account(svc, status);
 	svc->start_time = svc->pid = 0;
+	heartbeat_stop(svc);
+
+	/*
+	 * When stopping we wait for the rest of the process tree to exit
+	 * as well.  A crashed daemon must not leave any orphans behind for
+	 * the next instance, but those of a task or run are on purpose.
+	 */
+	if (svc->state != SVC_STOPPING_STATE) {
+		if (svc_is_daemon(svc) || svc_is_redir(svc))
+			tree_kill(svc, SIGKILL);
+		svc->pgid = 0;
+	}
 
 	if (!service_step(svc)) {
 		/* Clean out any bootstrap tasks, they've had their time in the sun. */
@@ -988,7 +1407,7 @@ restart:
 
 	_d("%20s(%4d): %8s %3sabled/%-7s cond:%-4s", svc->cmd, svc->pid,
 	   svc_status(svc), enabled ? "en" : "dis", svc_dirtystr(svc),
-	   condstr(cond_get_agg(svc->cond)));
+	   condstr(cond_get_agg(svc_cond(svc))));
 
 	switch (svc->state) {
 	case SVC_HALTED_STATE:
@@ -1009,6 +1428,10 @@ restart:
 
 	case SVC_STOPPING_STATE:
 		if (!svc->pid) {
+			/* Wait for the rest, the SIGKILL timer is still armed */
+			if (tree_alive(svc))
+				break;
+
 			/* PID was collected normally, no need to kill it */
 			service_timeout_cancel(svc);
 
@@ -1034,7 +1457,7 @@ restart:
 	case SVC_READY_STATE:
 		if (!enabled) {
 			svc_set_state(svc, SVC_HALTED_STATE);
-		} else if (cond_get_agg(svc->cond) == COND_ON) {
+		} else if (cond_get_agg(svc_cond(svc)) == COND_ON) {
 			/* wait until all processes have been stopped before continuing... */
 			if (sm_is_in_teardown(&sm))
 				break;
@@ -1064,7 +1487,7 @@ restart:
 		}
 
 		if (!svc->pid) {
-			if (svc_is_daemon(svc)) {
+			if (svc_is_daemon(svc) || svc_is_redir(svc)) {
 				svc_restarting(svc);
 				svc_set_state(svc, SVC_HALTED_STATE);
 
@@ -1073,6 +1496,7 @@ restart:
 				 * then retry after 2 sec
 				 */
 				_d("delayed restart of %s", svc->cmd);
+				service_timeout_cancel(svc);	/* SIGKILL timer, if hung */
 				service_timeout_after(svc, 1, service_retry);
 				break;
 			}
@@ -1089,7 +1513,7 @@ restart:
 			}
 		}
 
-		cond = cond_get_agg(svc->cond);
+		cond = cond_get_agg(svc_cond(svc));
 		switch (cond) {
 		case COND_OFF:
 			service_stop(svc);
@@ -1129,7 +1553,7 @@ restart:
 			break;
 		}
 
-		cond = cond_get_agg(svc->cond);
+		cond = cond_get_agg(svc_cond(svc));
 		switch (cond) {
 		case COND_ON:
 			kill(svc->pid, SIGCONT);
@@ -1205,9 +1629,9 @@ int service_runtask_completed(int skip)
 		if (!svc_enabled(svc))
 			continue;
 
-		if (strstr(svc->cond, plugin_hook_str(HOOK_SVC_UP)) ||
-		    strstr(svc->cond, plugin_hook_str(HOOK_SYSTEM_UP))) {
-			_d("Skipping %s(%s), post-strap hook", svc->desc, svc->cmd);
+		if (strstr(svc_cond(svc), plugin_hook_str(HOOK_SVC_UP)) ||
+		    strstr(svc_cond(svc), plugin_hook_str(HOOK_SYSTEM_UP))) {
+			_d("Skipping %s(%s), post-strap hook", svc_desc(svc), svc->cmd);
 			continue;
 		}
 
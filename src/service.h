@@ -35,6 +35,7 @@ void      service_runtask_clean  (void);
 void      service_reload_dynamic (void);
 
 int       service_step           (svc_t *svc);
+void      service_heartbeat      (svc_t *svc);
 void      service_step_all       (int types);
 
 void      service_bootstrap_cb   (uev_t *w, void *arg, int events);
@@ -76,8 +76,10 @@
 #include "conf.h"
 #include "config.h"
 #include "helpers.h"
+#include "pidfd.h"
 #include "plugin.h"
 #include "private.h"
+#include "prof.h"
 #include "sig.h"
 #include "service.h"
 #include "util.h"
@@ -97,8 +99,6 @@ static uev_t sigchld_watcher;
 static uev_t sigstop_watcher, sigtstp_watcher, sigcont_watcher;
 
 void mdadm_wait(void);
-void unmount_tmpfs(void);
-void unmount_regular(void);
 
 /*
  * Kernel threads have no cmdline so fgets() returns NULL for them.  We
@@ -192,16 +192,14 @@ void do_shutdown(shutop_t op)
 
 	/* Unmount any tmpfs before unmounting swap ... */
 	unmount_tmpfs();
-	run("swapoff -e -a");
+	swap_off();
 
 	/* ... unmount remaining regular file systems. */
 	unmount_regular();
 
 	/* We sit on / so we must remount it ro, try all the things! */
 	sync();
-	run("mount -n -o remount,ro -t dummytype dummydev /");
-	run("mount -n -o remount,ro dummydev /");
-	run("mount -n -o remount,ro /");
+	remount_root(1);
 
 	/* Call mdadm to mark any RAID array(s) as clean before halting. */
 	mdadm_wait();
@@ -313,21 +311,33 @@ static void sigterm_cb(uev_t *w, void *arg, int events)
  */
 static void sigchld_cb(uev_t *w, void *arg, int events)
 {
+	uint64_t t0 = prof_now();
 	pid_t pid;
+	int status;
 
 	if (UEV_ERROR == events) {
 		_e("Unrecoverable error in signal watcher");
 		return;
 	}
 
-	/* Reap all the children! */
-	do {
-		pid = waitpid(-1, NULL, WNOHANG);
-		if (pid > 0) {
-			_d("Collected child %d", pid);
-			service_monitor(pid);
-		}
-	} while (pid > 0);
+	/* Reap all the children!  Those from pidfd_fork() by their owner */
+	while (1) {
+		siginfo_t info = { 0 };
+
+		if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) || !info.si_pid)
+			break;
+		if (pidfd_exited(info.si_pid))
+			continue;
+
+		pid = waitpid(info.si_pid, &status, WNOHANG);
+		if (pid <= 0)
+			break;
+
+		_d("Collected child %d", pid);
+		service_monitor(pid, status);
+	}
+
+	prof_add("sigchld", NULL, t0);
 }
 
 /*
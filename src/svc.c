@@ -24,21 +24,258 @@
 
 #include <err.h>
 #include <ctype.h>		/* isdigit() */
+#include <stddef.h>		/* offsetof() */
 #include <stdlib.h>
 #include <strings.h>
 #include <sys/time.h>
 #include <lite/queue.h>		/* BSD sys/queue.h API */
 
 #include "finit.h"
+#include "conf.h"
 #include "svc.h"
 #include "helpers.h"
 #include "pid.h"
+#include "pidfd.h"
 #include "util.h"
 
 /* Each svc_t needs a unique job# */
 static int jobcounter = 1;
 static TAILQ_HEAD(head, svc) svc_list = TAILQ_HEAD_INITIALIZER(svc_list);
 
+/*
+ * Free list of zeroed svc_t objects, recycled by svc_del().  Mainly for
+ * inetd connections, which come and go, to reduce allocator churn and
+ * heap fragmentation in PID 1.
+ */
+#define SVC_POOL_MAX 16
+static TAILQ_HEAD(, svc) svc_pool = TAILQ_HEAD_INITIALIZER(svc_pool);
+static int svc_pool_len = 0;
+
+/*
+ * Interned &svc_conf_t records.  Services declared with the same options
+ * share one record, as do all instances and inetd connections.
+ */
+static LIST_HEAD(, svc_conf) conf_list = LIST_HEAD_INITIALIZER(conf_list);
+
+/* Content of a &svc_conf_t, i.e., what is compared when interning */
+#define CONF_DATA(c)   ((char *)(c) + offsetof(svc_conf_t, rlimit))
+#define CONF_DLEN(c)   ((c)->len - offsetof(svc_conf_t, rlimit))
+
+static svc_t *svc_alloc(void)
+{
+	svc_t *svc;
+
+	svc = TAILQ_FIRST(&svc_pool);
+	if (!svc)
+		return calloc(1, sizeof(*svc));
+
+	TAILQ_REMOVE(&svc_pool, svc, link);
+	svc_pool_len--;
+
+	return svc;
+}
+
+/* Put zeroed @svc back on the free list, or free it if the list is full */
+static void svc_free(svc_t *svc)
+{
+	if (svc_pool_len < SVC_POOL_MAX) {
+		TAILQ_INSERT_HEAD(&svc_pool, svc, link);
+		svc_pool_len++;
+		return;
+	}
+
+	free(svc);
+}
+
+static unsigned int conf_hash(svc_conf_t *conf)
+{
+	unsigned int hash = 5381;
+	char *ptr = CONF_DATA(conf);
+	size_t i;
+
+	for (i = 0; i < CONF_DLEN(conf); i++)
+		hash = hash * 33 + ptr[i];
+
+	return hash;
+}
+
+static void conf_put(svc_conf_t *conf)
+{
+	if (!conf || --conf->refcnt > 0)
+		return;
+
+	LIST_REMOVE(conf, link);
+	free(conf);
+}
+
+/* Append @str to packed record, identical strings are only stored once */
+static uint16_t conf_str(svc_conf_t *conf, size_t *len, char *str)
+{
+	size_t off = 0;
+
+	if (!str[0])
+		return 0;
+
+	while (off < *len) {
+		if (!strcmp(&conf->str[off], str))
+			return off;
+		off += strlen(&conf->str[off]) + 1;
+	}
+
+	strcpy(&conf->str[off], str);
+	*len += strlen(str) + 1;
+
+	return off;
+}
+
+/* Pack and intern @buf, returns a referenced &svc_conf_t */
+static svc_conf_t *conf_pack(svc_conf_buf_t *buf)
+{
+	svc_conf_t *conf, *iter;
+	size_t len = 0;
+	int i, argc;
+
+	for (argc = 0; argc < MAX_NUM_SVC_ARGS && buf->args[argc][0]; argc++)
+		len += strlen(buf->args[argc]) + 1;
+	len += strlen(buf->pidfile) + strlen(buf->cond) + strlen(buf->username) +
+		strlen(buf->group) + strlen(buf->cgroup) + strlen(buf->desc) +
+		strlen(buf->log.file) + strlen(buf->log.prio) + strlen(buf->log.ident) + 10;
+
+	/* Upper bound, duplicates are packed and offsets must fit */
+	if (len > UINT16_MAX) {
+		errno = E2BIG;
+		return NULL;
+	}
+
+	conf = calloc(1, sizeof(*conf) + len);
+	if (!conf)
+		return NULL;
+
+	/* The empty string, at offset 0, shared by all unset fields */
+	len = 1;
+	memcpy(conf->rlimit, buf->rlimit, sizeof(conf->rlimit));
+	conf->log.enabled = buf->log.enabled;
+	conf->log.null    = buf->log.null;
+	conf->critical    = buf->critical;
+	conf->heartbeat   = buf->heartbeat;
+	conf->log.file    = conf_str(conf, &len, buf->log.file);
+	conf->log.prio    = conf_str(conf, &len, buf->log.prio);
+	conf->log.ident   = conf_str(conf, &len, buf->log.ident);
+	conf->pidfile     = conf_str(conf, &len, buf->pidfile);
+	conf->cond        = conf_str(conf, &len, buf->cond);
+	conf->username    = conf_str(conf, &len, buf->username);
+	conf->group       = conf_str(conf, &len, buf->group);
+	conf->cgroup      = conf_str(conf, &len, buf->cgroup);
+	conf->desc        = conf_str(conf, &len, buf->desc);
+	conf->argc        = argc;
+	for (i = 0; i < argc; i++)
+		conf->argv[i] = conf_str(conf, &len, buf->args[i]);
+	conf->len  = SVC_CONF_HDR + len;
+	conf->hash = conf_hash(conf);
+
+	LIST_FOREACH(iter, &conf_list, link) {
+		if (iter->hash != conf->hash || iter->len != conf->len)
+			continue;
+		if (memcmp(CONF_DATA(iter), CONF_DATA(conf), CONF_DLEN(conf)))
+			continue;
+
+		free(conf);
+		iter->refcnt++;
+
+		return iter;
+	}
+
+	/* Give back what the duplicates did not need */
+	iter = realloc(conf, sizeof(*conf) + len);
+	if (iter)
+		conf = iter;
+
+	conf->refcnt = 1;
+	LIST_INSERT_HEAD(&conf_list, conf, link);
+
+	return conf;
+}
+
+/**
+ * svc_conf_init - Initialize a config buffer for a service
+ * @buf: Pointer to &svc_conf_buf_t to initialize
+ * @cmd: Command of service, used for the default description
+ *
+ * All limits are unset, i.e. zero, the caller is expected to set them.
+ */
+void svc_conf_init(svc_conf_buf_t *buf, char *cmd)
+{
+	char *desc;
+
+	memset(buf, 0, sizeof(*buf));
+
+	/* Default description, if missing */
+	desc = strrchr(cmd, '/');
+	if (desc)
+		desc++;
+	else
+		desc = cmd;
+	strlcpy(buf->desc, desc, sizeof(buf->desc));
+}
+
+/**
+ * svc_conf_set - Set new configuration of a service
+ * @svc: Pointer to &svc_t of service
+ * @buf: Pointer to &svc_conf_buf_t with the parsed configuration
+ *
+ * Packs @buf into a shared &svc_conf_t.  The old configuration of @svc,
+ * if any, is released.
+ *
+ * Returns:
+ * POSIX OK(0) on success, otherwise non-zero with errno set and the
+ * old configuration of @svc, if any, still in place.
+ */
+int svc_conf_set(svc_t *svc, svc_conf_buf_t *buf)
+{
+	svc_conf_t *conf;
+
+	conf = conf_pack(buf);
+	if (!conf)
+		return 1;
+
+	conf_put(svc->conf);
+	svc->conf = conf;
+
+	return 0;
+}
+
+/**
+ * svc_conf_get - Get a copy of the configuration of a service
+ * @svc: Pointer to &svc_t of service
+ * @buf: Pointer to &svc_conf_buf_t to unpack the configuration into
+ *
+ * Used to modify parts of an already packed configuration, followed
+ * by svc_conf_set().
+ */
+void svc_conf_get(svc_t *svc, svc_conf_buf_t *buf)
+{
+	svc_conf_t *conf = svc->conf;
+	int i;
+
+	memset(buf, 0, sizeof(*buf));
+	memcpy(buf->rlimit, conf->rlimit, sizeof(buf->rlimit));
+	buf->log.enabled = conf->log.enabled;
+	buf->log.null    = conf->log.null;
+	buf->critical    = conf->critical;
+	buf->heartbeat   = conf->heartbeat;
+	strlcpy(buf->log.file,  svc_conf_str(conf, conf->log.file),  sizeof(buf->log.file));
+	strlcpy(buf->log.prio,  svc_conf_str(conf, conf->log.prio),  sizeof(buf->log.prio));
+	strlcpy(buf->log.ident, svc_conf_str(conf, conf->log.ident), sizeof(buf->log.ident));
+	strlcpy(buf->pidfile,   svc_conf_str(conf, conf->pidfile),   sizeof(buf->pidfile));
+	strlcpy(buf->cond,      svc_conf_str(conf, conf->cond),      sizeof(buf->cond));
+	strlcpy(buf->username,  svc_conf_str(conf, conf->username),  sizeof(buf->username));
+	strlcpy(buf->group,     svc_conf_str(conf, conf->group),     sizeof(buf->group));
+	strlcpy(buf->cgroup,    svc_conf_str(conf, conf->cgroup),    sizeof(buf->cgroup));
+	strlcpy(buf->desc,      svc_conf_str(conf, conf->desc),      sizeof(buf->desc));
+	for (i = 0; i < conf->argc; i++)
+		strlcpy(buf->args[i], svc_conf_str(conf, conf->argv[i]), sizeof(buf->args[i]));
+}
+
 /**
  * svc_new - Create a new service
  * @cmd:  External program to call, or 'internal' for internal inetd services
@@ -51,7 +288,7 @@ static TAILQ_HEAD(head, svc) svc_list = TAILQ_HEAD_INITIALIZER(svc_list);
 svc_t *svc_new(char *cmd, int id, int type)
 {
 	int job = -1;
-	char *desc;
+	svc_conf_buf_t buf;
 	svc_t *svc, *iter = NULL;
 
 	/* Find first job n:o if registering multiple instances */
@@ -64,22 +301,59 @@ svc_t *svc_new(char *cmd, int id, int type)
 	if (job == -1)
 		job = jobcounter++;
 
-	svc = calloc(1, sizeof(*svc));
+	svc = svc_alloc();
 	if (!svc)
 		return NULL;
 
+	svc_conf_init(&buf, cmd);
+	if (svc_conf_set(svc, &buf)) {
+		svc_free(svc);
+		return NULL;
+	}
+
 	svc->type = type;
 	svc->job  = job;
 	svc->id   = id;
+	svc->status   = -1;
+	svc->pidfd.fd = -1;
+	svc->stats.ready_ms = -1;
 	strlcpy(svc->cmd, cmd, sizeof(svc->cmd));
 
-	/* Default description, if missing */
-	desc = strrchr(cmd, '/');
-	if (desc)
-		desc++;
-	else
-		desc = cmd;
-	strlcpy(svc->desc, desc, sizeof(svc->desc));
+	TAILQ_INSERT_TAIL(&svc_list, svc, link);
+
+	return svc;
+}
+
+/**
+ * svc_new_instance - Create a new instance of a service
+ * @base: Pointer to &svc_t of the service
+ * @id:   Instance id
+ * @type: Service type of the new instance, e.g. inetd connection
+ *
+ * Like svc_new(), but the new instance shares the job number and the
+ * configuration of @base, so there is no need to scan all services or
+ * to copy anything.
+ *
+ * Returns:
+ * A pointer to a new &svc_t object, or %NULL if out of memory.
+ */
+svc_t *svc_new_instance(svc_t *base, int id, int type)
+{
+	svc_t *svc;
+
+	svc = svc_alloc();
+	if (!svc)
+		return NULL;
+
+	svc->type = type;
+	svc->job  = base->job;
+	svc->id   = id;
+	svc->status   = -1;
+	svc->pidfd.fd = -1;
+	svc->stats.ready_ms = -1;
+	svc->conf = base->conf;
+	svc->conf->refcnt++;
+	strlcpy(svc->cmd, base->cmd, sizeof(svc->cmd));
 
 	TAILQ_INSERT_TAIL(&svc_list, svc, link);
 
@@ -96,8 +370,14 @@ svc_t *svc_new(char *cmd, int id, int type)
 int svc_del(svc_t *svc)
 {
 	TAILQ_REMOVE(&svc_list, svc, link);
+	if (svc->pid > 1)
+		pidfd_release(&svc->pidfd, svc->pid);
+	conf_put(svc->conf);
+	if (svc->file)
+		free(svc->file);
 	memset(svc, 0, sizeof(*svc));
-	free(svc);
+
+	svc_free(svc);
 
 	return 0;
 }
@@ -386,6 +666,25 @@ void svc_mark_dynamic(void)
 	}
 }
 
+/**
+ * svc_mark_changed - Mark services loaded from changed .conf files for deletion.
+ *
+ * Like svc_mark_dynamic(), but only services declared in .conf files
+ * in /etc/finit.d/ that have changed since the last reload.  Used for
+ * incremental reload, the changed files are then reparsed.
+ */
+void svc_mark_changed(void)
+{
+	svc_t *svc, *iter = NULL;
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		if (svc->protected || !conf_changed(svc->file))
+			continue;
+
+		*((int *)&svc->dirty) = -1;
+	}
+}
+
 void svc_mark_dirty(svc_t *svc)
 {
 	*((int *)&svc->dirty) = 1;
@@ -506,6 +805,23 @@ int svc_is_unique(svc_t *svc)
 	return unique;
 }
 
+/**
+ * svc_started - Service has (re)asserted its pidfile
+ * @svc: Pointer to &svc_t of service
+ *
+ * The first time after a start this also records the time it took
+ * for the service to become ready, from fork() to pidfile.
+ */
+void svc_started(svc_t *svc)
+{
+	svc->starting = 0;
+
+	if (svc->stats.fork_ms) {
+		svc->stats.ready_ms = now_ms() - svc->stats.fork_ms;
+		svc->stats.fork_ms  = 0;
+	}
+}
+
 /*
  * Used by api.c (to start/stop/restart) and initctl.c (for input validation)
  */
@@ -25,6 +25,7 @@
 #ifndef FINIT_SVC_H_
 #define FINIT_SVC_H_
 
+#include <stddef.h>		/* offsetof() */
 #include <sys/ipc.h>		/* IPC_CREAT */
 #include <sys/resource.h>
 #include <sys/types.h>		/* pid_t */
@@ -47,6 +48,7 @@ typedef enum {
 
 #define SVC_TYPE_ANY          (-1)
 #define SVC_TYPE_RUNTASK      (6)
+#define SVC_TYPE_REDIR        (-2)	/* service_register(): redir, an inetd */
 
 typedef enum {
 	SVC_HALTED_STATE = 0,	/* Not allowed in runlevel, or not enabled. */
@@ -72,12 +74,107 @@ typedef enum {
 #define MAX_USER_LEN     16
 #define MAX_NUM_FDS      64	     /* Max number of I/O plugins */
 #define MAX_NUM_SVC_ARGS 32
+#define MAX_EXIT_CODES   16	     /* Exit code histogram, last is >= 15 */
+
+/*
+ * Scratch buffer used when parsing a service declaration, packed into
+ * an &svc_conf_t by svc_conf_set() when done.
+ */
+typedef struct {
+	struct rlimit  rlimit[RLIMIT_NLIMITS];
+	char           pidfile[MAX_ARG_LEN];
+	char           cond[MAX_COND_LEN];
+	char           critical;       /* Built-in watchdog supervises it */
+	int            heartbeat;      /* sec, max time between pidfile touches */
+
+	/* Set for services we need to redirect stdout/stderr to syslog */
+	struct {
+		char   enabled;
+		char   null;
+		char   file[64];
+		char   prio[20];
+		char   ident[20];
+	} log;
+
+	/* Identity */
+	char	       username[MAX_USER_LEN];
+	char	       group[MAX_USER_LEN];
+
+	/* cgroup settings, "file:value" separated by space, see cgroup.c */
+	char           cgroup[MAX_COND_LEN];
+
+	/* Arguments and service description */
+	char	       args[MAX_NUM_SVC_ARGS][MAX_ARG_LEN];
+	char	       desc[MAX_STR_LEN];
+} svc_conf_buf_t;
+
+/*
+ * Service configuration, immutable once packed.  Identical records are
+ * interned and shared, e.g. between an inetd service and its connections.
+ * The strings are packed after the struct and referenced by offset, so
+ * the record can be sent as-is to initctl, see api.c.
+ */
+typedef struct svc_conf {
+	LIST_ENTRY(svc_conf) link;
+	int            refcnt;
+	unsigned int   hash;
+	size_t         len;	       /* Size of record, including strings */
+
+	/* Limits and scoping */
+	struct rlimit  rlimit[RLIMIT_NLIMITS];
+
+	struct {
+		char     enabled;
+		char     null;
+		uint16_t file;
+		uint16_t prio;
+		uint16_t ident;
+	} log;
+
+	char           critical;
+	int            heartbeat;
+	uint16_t       pidfile;
+	uint16_t       cond;
+	uint16_t       username;
+	uint16_t       group;
+	uint16_t       cgroup;
+	uint16_t       desc;
+	uint16_t       argc;
+	uint16_t       argv[MAX_NUM_SVC_ARGS];
+
+	char           str[];	       /* Always starts with an empty string */
+} svc_conf_t;
+
+/* Size of the record up to the strings, svc_conf_t.len counts from here */
+#define SVC_CONF_HDR   offsetof(svc_conf_t, str)
+
+/*
+ * Runtime statistics of a service, kept for as long as the service is
+ * registered, i.e. across restarts and reloads.  See 'initctl stats'.
+ */
+typedef struct {
+	uint32_t       starts;	       /* Successful fork() */
+	uint32_t       crashes;	       /* Exits not asked for by finit */
+	uint32_t       exits[MAX_EXIT_CODES];
+	uint32_t       signals;	       /* Killed by a signal */
+	int            last_signal;
+	long           uptime;	       /* Seconds, sum of all completed runs */
+	long           fork_ms;	       /* Monotonic time of fork(), until ready */
+	long           ready_ms;       /* Last time from fork() to ready, or -1 */
+
+	/* For inetd services */
+	uint32_t       accepted;
+	uint32_t       refused;
+} svc_stats_t;
 
 /*
  * Default enable for all services, can be stopped by means
  * of issuing an initctl call. E.g.
  *
  *   initctl <stop|start|restart> service
+ *
+ * The fields used by the state machine are kept first, the config is
+ * in a separate record, and the inetd details last.
  */
 typedef struct svc {
 	TAILQ_ENTRY(svc) link;
@@ -85,48 +182,29 @@ typedef struct svc {
 	/* Instance specifics */
 	int            job, id;	       /* JOB:ID */
 
-	/* Limits and scoping */
-	struct rlimit  rlimit[RLIMIT_NLIMITS];
-
 	/* Service details */
-	pid_t	       pid;
-	char           pidfile[MAX_ARG_LEN];
-	long           start_time;     /* Start time, as seconds since boot, from sysinfo() */
 	const svc_state_t state;       /* Paused, Reloading, Restart, Running, ... */
 	svc_type_t     type;	       /* Service, run, task, inetd, ... */
-	int            protected;      /* Services like dbus-daemon & udev by Finit */
+	svc_block_t    block;	       /* Reason that this service is currently stopped */
 	const int      dirty;	       /* -1: removal, 0: unmodified, 1: modified */
-	int            starting;       /* ... waiting for pidfile to be re-asserted */
+	pid_t	       pid;
+	pid_t          pgid;	       /* Process group, while tracking process tree */
 	int	       runlevels;
+	int            starting;       /* ... waiting for pidfile to be re-asserted */
 	int            sighup;	       /* This service supports SIGHUP :) */
-	svc_block_t    block;	       /* Reason that this service is currently stopped */
-	char           cond[MAX_COND_LEN];
+	int            protected;      /* Services like dbus-daemon & udev by Finit */
 
 	/* Counters */
 	char           once;	       /* run/task, (at least) once per runlevel */
 	const char     restart_cnt;    /* Incremented for each restart by service monitor. */
 
-	/* For inetd services */
-	inetd_t        inetd;
-	int            stdin_fd;
-
-	/* Set for services we need to redirect stdout/stderr to syslog */
-	struct {
-		char   enabled;
-		char   null;
-		char   file[64];
-		char   prio[20];
-		char   ident[20];
-	} log;
-
-	/* Identity */
-	char	       username[MAX_USER_LEN];
-	char	       group[MAX_USER_LEN];
+	long           start_time;     /* Start time, as seconds since boot, from sysinfo() */
+	int            status;	       /* Last exit status from waitpid(), or -1 */
+	svc_conf_t    *conf;	       /* Shared, see svc_conf_set() */
 
-	/* Command, arguments and service description */
+	/* Command, used to find service */
 	char	       cmd[MAX_ARG_LEN];
-	char	       args[MAX_NUM_SVC_ARGS][MAX_ARG_LEN];
-	char	       desc[MAX_STR_LEN];
+	char          *file;	       /* .conf in finit.d/ declaring service, or NULL */
 
 	/*
 	 * Used to forcefully kill services that won't shutdown on
@@ -134,11 +212,29 @@ typedef struct svc {
 	 */
 	uev_t          timer;
 	void           (*timer_cb)(struct svc *svc);
+
+	/* Exit of pid, see pidfd.c */
+	uev_t          pidfd;
+
+	/* Liveness deadline, moved by each heartbeat */
+	uev_t          hb_timer;
+	int            hb_armed;
+
+	svc_stats_t    stats;
+
+	/* For inetd services */
+	int            stdin_fd;
+	inetd_t        inetd;
 } svc_t;
 
 svc_t      *svc_new                (char *cmd, int id, int type);
+svc_t      *svc_new_instance       (svc_t *base, int id, int type);
 int	    svc_del	           (svc_t *svc);
 
+void        svc_conf_init          (svc_conf_buf_t *buf, char *cmd);
+void        svc_conf_get           (svc_t *svc, svc_conf_buf_t *buf);
+int         svc_conf_set           (svc_t *svc, svc_conf_buf_t *buf);
+
 svc_t	   *svc_find	           (char *cmd, int id);
 svc_t	   *svc_find_by_pid        (pid_t pid);
 svc_t	   *svc_find_by_jobid      (int job, int id);
@@ -156,6 +252,7 @@ void        svc_foreach_type       (int types, int (*cb)(svc_t *));
 svc_t	   *svc_stop_completed	   (void);
 
 void	    svc_mark_dynamic       (void);
+void	    svc_mark_changed       (void);
 void	    svc_mark_dirty         (svc_t *svc);
 void	    svc_mark_clean         (svc_t *svc);
 void	    svc_clean_dynamic      (void (*cb)(svc_t *));
@@ -165,20 +262,30 @@ void	    svc_prune_bootstrap	   (void);
 int         svc_enabled            (svc_t *svc);
 int         svc_next_id            (char  *cmd);
 int         svc_is_unique          (svc_t *svc);
+void        svc_started            (svc_t *svc);
 
 int         svc_parse_jobstr       (char *str, size_t len, int (*found)(svc_t *), int (not_found)(char *, int));
 
 static inline int svc_is_inetd     (svc_t *svc) { return svc && SVC_TYPE_INETD      == svc->type; }
 static inline int svc_is_inetd_conn(svc_t *svc) { return svc && SVC_TYPE_INETD_CONN == svc->type; }
+static inline int svc_is_redir     (svc_t *svc) { return svc_is_inetd(svc) && svc->inetd.redir;   }
+
+/* Accessors for strings in the &svc_conf_t of a service */
+static inline char *svc_conf_str   (svc_conf_t *conf, uint16_t off) { return &conf->str[off]; }
+static inline char *svc_desc       (svc_t *svc) { return svc_conf_str(svc->conf, svc->conf->desc);    }
+static inline char *svc_cond       (svc_t *svc) { return svc_conf_str(svc->conf, svc->conf->cond);    }
+static inline char *svc_pidfile    (svc_t *svc) { return svc_conf_str(svc->conf, svc->conf->pidfile); }
+static inline char *svc_cgroup     (svc_t *svc) { return svc_conf_str(svc->conf, svc->conf->cgroup);  }
+static inline char *svc_arg        (svc_t *svc, int i) { return svc_conf_str(svc->conf, svc->conf->argv[i]); }
+
 static inline int svc_is_daemon    (svc_t *svc) { return svc && SVC_TYPE_SERVICE    == svc->type; }
 static inline int svc_is_runtask   (svc_t *svc) { return svc && (SVC_TYPE_RUNTASK & svc->type);   }
 
 static inline int svc_in_runlevel  (svc_t *svc, int runlevel) { return svc && ISSET(svc->runlevels, runlevel); }
 static inline int svc_has_sighup   (svc_t *svc) { return svc &&  0 != svc->sighup; }
-static inline int svc_has_pidfile  (svc_t *svc) { return svc_is_daemon(svc) && svc->pidfile[0] != 0 && svc->pidfile[0] != '!'; }
+static inline int svc_has_pidfile  (svc_t *svc) { return svc_is_daemon(svc) && svc_pidfile(svc)[0] != 0 && svc_pidfile(svc)[0] != '!'; }
 
 static inline void svc_starting    (svc_t *svc) { svc->starting = 1;         }
-static inline void svc_started     (svc_t *svc) { svc->starting = 0;         }
 static inline int  svc_is_starting (svc_t *svc) { return 0 != svc->starting; }
 
 static inline int svc_is_removed   (svc_t *svc) { return svc && -1 == svc->dirty; }
@@ -34,6 +34,8 @@
 #include "finit.h"
 #include "conf.h"
 #include "helpers.h"
+#include "pidfd.h"
+#include "sig.h"
 #include "tty.h"
 #include "util.h"
 #include "utmp-api.h"
@@ -94,6 +96,17 @@ void tty_mark(void)
 		tty->dirty = -1;
 }
 
+/* Only TTYs from .conf files changed since last reload */
+void tty_mark_changed(void)
+{
+	tty_node_t *tty;
+
+	LIST_FOREACH(tty, &tty_list, link) {
+		if (conf_changed(tty->file))
+			tty->dirty = -1;
+	}
+}
+
 void tty_sweep(void)
 {
 	tty_node_t *tty, *tmp;
@@ -236,6 +249,7 @@ int tty_register(char *line, struct rlimit rlimit[], char *file)
 				free(cmd);
 			return errno = ENOMEM;
 		}
+		entry->data.pidfd.fd = -1;
 	}
 
 	entry->data.name = dev;
@@ -272,6 +286,11 @@ int tty_register(char *line, struct rlimit rlimit[], char *file)
 	/* Register configured limits */
 	memcpy(entry->data.rlimit, rlimit, sizeof(entry->data.rlimit));
 
+	/* Remember origin, for incremental reload */
+	if (entry->file)
+		free(entry->file);
+	entry->file = file ? strdup(basename(file)) : NULL;
+
 	if (file && conf_changed(file))
 		entry->dirty = 1; /* Modified, restart */
 	else
@@ -290,6 +309,8 @@ int tty_unregister(tty_node_t *tty)
 
 	LIST_REMOVE(tty, link);
 
+	if (tty->data.pid)
+		pidfd_release(&tty->data.pidfd, tty->data.pid);
 	if (tty->data.name)
 		free(tty->data.name);
 	if (tty->data.baud)
@@ -306,6 +327,8 @@ int tty_unregister(tty_node_t *tty)
 			tty->data.args[i] = NULL;
 		}
 	}
+	if (tty->file)
+		free(tty->file);
 	free(tty);
 
 	return 0;
@@ -375,9 +398,12 @@ static int tty_exist(char *dev)
 	return result;
 }
 
+static void tty_exit_cb(uev_t *w, void *arg, int events);
+
 void tty_start(finit_tty_t *tty)
 {
 	char *dev;
+	pid_t pid;
 
 	if (tty->pid) {
 		_d("%s: TTY already active", tty->name);
@@ -395,15 +421,21 @@ void tty_start(finit_tty_t *tty)
 		return;
 	}
 
-	if (tty->nologin) {
-		tty->pid = run_sh(dev, tty->noclear, tty->nowait, tty->rlimit);
+	pid = pidfd_fork(&tty->pidfd, tty_exit_cb, tty);
+	if (pid) {
+		if (pid < 0)
+			_pe("%s: Failed starting TTY", tty->name);
+		else
+			tty->pid = pid;
 		return;
 	}
 
-	if (!tty->cmd)
-		tty->pid = run_getty(dev, tty->baud, tty->term, tty->noclear, tty->nowait, tty->rlimit);
+	if (tty->nologin)
+		exec_sh(dev, tty->noclear, tty->nowait, tty->rlimit);
+	else if (!tty->cmd)
+		exec_getty(dev, tty->baud, tty->term, tty->noclear, tty->nowait, tty->rlimit);
 	else
-		tty->pid = run_getty2(dev, tty->cmd, tty->args, tty->noclear, tty->nowait, tty->rlimit);
+		exec_getty2(dev, tty->cmd, tty->args, tty->noclear, tty->nowait, tty->rlimit);
 }
 
 void tty_stop(finit_tty_t *tty)
@@ -419,7 +451,7 @@ void tty_stop(finit_tty_t *tty)
 	 */
 	_d("Stopping TTY %s", tty->name);
 	kill(tty->pid, SIGKILL);
-	waitpid(tty->pid, NULL, 0);
+	pidfd_wait(&tty->pidfd, tty->pid, NULL, 0);
 	tty->pid = 0;
 }
 
@@ -471,16 +503,43 @@ int tty_fallback(pid_t lost)
 	return 0;
 }
 
-static void tty_action(tty_node_t *tty)
+static void tty_action(finit_tty_t *tty)
 {
-	if (!tty_enabled(&tty->data))
-		tty_stop(&tty->data);
+	if (!tty_enabled(tty))
+		tty_stop(tty);
 	else
-		tty_start(&tty->data);
+		tty_start(tty);
+}
+
+static void tty_lost(finit_tty_t *tty)
+{
+	/* Set DEAD_PROCESS UTMP entry */
+	utmp_set_dead(tty->pid);
+
+	/* Clear PID to be able to respawn it. */
+	tty->pid = 0;
+	tty_action(tty);
+}
+
+/* Exit of TTY started with pidfd_fork(), no need to look it up */
+static void tty_exit_cb(uev_t *w, void *arg, int events)
+{
+	finit_tty_t *tty = (finit_tty_t *)arg;
+
+	if (pidfd_wait(w, tty->pid, NULL, WNOHANG) <= 0)
+		return;
+
+	_d("Collected TTY %s(%d)", tty->name, tty->pid);
+	if (fexist(SYNC_SHUTDOWN)) {
+		tty->pid = 0;
+		return;
+	}
+
+	tty_lost(tty);
 }
 
 /*
- * TTY monitor, called by service_monitor()
+ * TTY monitor, called by service_monitor() on older kernels
  */
 int tty_respawn(pid_t pid)
 {
@@ -489,12 +548,7 @@ int tty_respawn(pid_t pid)
 	if (!tty)
 		return tty_fallback(pid);
 
-	/* Set DEAD_PROCESS UTMP entry */
-	utmp_set_dead(pid);
-
-	/* Clear PID to be able to respawn it. */
-	tty->data.pid = 0;
-	tty_action(tty);
+	tty_lost(&tty->data);
 
 	return 1;
 }
@@ -513,7 +567,7 @@ void tty_reload(char *dev)
 			return;
 		}
 
-		tty_action(tty);
+		tty_action(&tty->data);
 		tty->dirty = 0;
 		return;
 	}
@@ -521,7 +575,7 @@ void tty_reload(char *dev)
 	tty_sweep();
 
 	LIST_FOREACH(tty, &tty_list, link) {
-		tty_action(tty);
+		tty_action(&tty->data);
 		tty->dirty = 0;
 	}
 }
@@ -532,7 +586,7 @@ void tty_runlevel(void)
 	tty_node_t *tty;
 
 	LIST_FOREACH(tty, &tty_list, link)
-		tty_action(tty);
+		tty_action(&tty->data);
 
 	/* Start fallback shell if enabled && no TTYs */
 	tty_fallback(tty_num_active() > 0 ? 1 : 0);
@@ -28,6 +28,7 @@
 #include <limits.h>
 #include <sys/resource.h>
 #include <lite/queue.h>		/* BSD sys/queue.h API */
+#include <uev/uev.h>
 
 #define TTY_MAX_ARGS 16
 #define EVENT_SIZE ((sizeof(struct inotify_event) + NAME_MAX + 1))
@@ -45,6 +46,7 @@ typedef struct {
 	char  *args[TTY_MAX_ARGS];
 
 	int    pid;
+	uev_t  pidfd;		/* Exit of pid, see pidfd.c */
 
 	/* Limits and scoping */
 	struct rlimit rlimit[RLIMIT_NLIMITS];
@@ -57,11 +59,13 @@ typedef struct tty_node {
 	/* XXX: Yes, TTYs should be refactored into a separate SVC type. */
 	int            dirty;	       /* Set if old mtime != new mtime  => reloaded,
 					* or -1 when marked for removal */
+	char          *file;	       /* .conf in finit.d/ declaring TTY, or NULL */
 } tty_node_t;
 
 //extern LIST_HEAD(, tty_node) tty_list;
 
 void	    tty_mark	    (void);
+void	    tty_mark_changed(void);
 void	    tty_sweep	    (void);
 
 int	    tty_register    (char *line, struct rlimit rlimit[], char *file);
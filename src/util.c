@@ -26,6 +26,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/sysinfo.h>	/* sysinfo() */
 #include <lite/lite.h>		/* strlcat() */
@@ -92,6 +93,16 @@ long jiffies(void)
 	return 0;
 }
 
+/* Milliseconds, from CLOCK_MONOTONIC */
+long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 char *uptime(long secs, char *buf, size_t len)
 {
 	long mins, hours, days, years;
@@ -22,99 +22,495 @@
  */
 
 #include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <linux/watchdog.h>
+#include <lite/lite.h>
 
 #include "finit.h"
 #include "log.h"
+#include "private.h"
+#include "svc.h"
+#include "util.h"
 #include "watchdog.h"
 
-int running  = 1;
-int handover = 0;
-int shutdown = 0;
+/*
+ * Health report, from PID 1 to the watchdog with the state of all
+ * critical services, and back to PID 1 on pre-timeout.
+ */
+typedef struct {
+	int  ok;
+	char why[64];
+} wdog_msg_t;
+
+static struct {
+	char   dev[MAX_ARG_LEN];
+	int    timeout;		/* sec */
+	int    interval;	/* sec, default timeout / 2 */
+	int    pretimeout;	/* sec before reset, 0: disabled */
+	int    boot;		/* sec, max bootstrap before first report */
+	double load;		/* Max 1 min load average, 0: disabled */
+	double memory;		/* Max PSI memory pressure, full avg10 */
+	char   writable[MAX_ARG_LEN];
+} wdt = {
+	.dev     = WDT_DEVNODE,
+	.timeout = WDT_TIMEOUT,
+	.boot    = WDT_BOOT,
+};
+
+/* Both sides */
+static int   wdog_sd = -1;
+static long  report_ms;		/* Period of health reports from PID 1 */
+
+/* PID 1 side */
+static uev_t report_timer;
+static uev_t notify_watcher;
+
+/* Watchdog side */
+static int   wdog_fd = -1;
+static int   going_down;
+static long  started;
+static long  last_report;	/* 0: PID 1 still bootstrapping */
+static wdog_msg_t report;
+static char  failed[sizeof(report.why)];
+static int   failing = -1;	/* Index of failed check */
+static uev_t pet_timer;
+static uev_t pre_timer;
+
+/* Is @svc alive, if it is critical and should run now? */
+static int critical_failed(svc_t *svc, char *why, size_t len)
+{
+	if (!svc_is_daemon(svc) || !svc->conf->critical)
+		return 0;
+	if (!svc_in_runlevel(svc, runlevel) || svc_is_removed(svc))
+		return 0;
+
+	switch (svc->block) {
+	case SVC_BLOCK_USER:
+		return 0;
+	case SVC_BLOCK_CRASHING:
+	case SVC_BLOCK_MISSING:
+		snprintf(why, len, "%s is %s", svc->cmd,
+			 svc->block == SVC_BLOCK_MISSING ? "missing" : "crashing");
+		return 1;
+	default:
+		break;
+	}
+
+	/* Starting, stopping, or waiting for conditions is transient */
+	if (svc->state == SVC_RUNNING_STATE && (svc->pid <= 1 || kill(svc->pid, 0))) {
+		snprintf(why, len, "%s is not running", svc->cmd);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void wdog_close(void)
+{
+	_d("Watchdog gone, stopping health reports.");
+	uev_timer_stop(&report_timer);
+	uev_io_stop(&notify_watcher);
+	close(wdog_sd);
+	wdog_sd = -1;
+}
 
-static void sighandler(int signo)
+/* Periodic report to watchdog, proves PID 1 is alive */
+static void report_cb(uev_t *w, void *arg, int events)
 {
-	if (signo == SIGTERM)
-		handover = 1;
-	if (signo == SIGPWR)
-		shutdown = 1;
+	wdog_msg_t msg = { .ok = 1 };
+	svc_t *svc, *iter = NULL;
+
+	for (svc = svc_iterator(&iter, 1); svc; svc = svc_iterator(&iter, 0)) {
+		if (critical_failed(svc, msg.why, sizeof(msg.why))) {
+			msg.ok = 0;
+			break;
+		}
+	}
 
-	running = 0;
+	if (send(wdog_sd, &msg, sizeof(msg), MSG_DONTWAIT | MSG_NOSIGNAL) < 0 && errno != EAGAIN)
+		wdog_close();
 }
 
-static int init(char *progname, char *devnode)
+/* Pre-timeout from watchdog, or EOF when it hands over or exits */
+static void notify_cb(uev_t *w, void *arg, int events)
 {
-	int fd;
+	static wdog_msg_t msg;
+	ssize_t len;
 
-	sprintf(progname, "@finit-watchdog");
-	signal(SIGTERM, sighandler);
-	signal(SIGPWR,  sighandler);
+	len = recv(w->fd, &msg, sizeof(msg), MSG_DONTWAIT);
+	if (len < 0 && errno == EAGAIN)
+		return;
+	if (len <= 0) {
+		wdog_close();
+		return;
+	}
 
-	fd = open(devnode, O_WRONLY);
-	if (fd == -1)
-		return -1;
+	msg.why[sizeof(msg.why) - 1] = 0;
+	plugin_run_hook(HOOK_WDOG_PRETIMEOUT, msg.why);
+}
 
-	return fd;
+/* Kick at least once before pre-timeout, e.g. 30 sec: 15 sec, or 10 sec */
+static void wdog_limits(void)
+{
+	if (!wdt.interval || wdt.interval >= wdt.timeout)
+		wdt.interval = wdt.timeout / 2 ?: 1;
+	if (wdt.pretimeout >= wdt.timeout)
+		wdt.pretimeout = 0;
+	if (wdt.pretimeout && wdt.timeout - wdt.pretimeout <= wdt.interval)
+		wdt.interval = (wdt.timeout - wdt.pretimeout) / 2 ?: 1;
 }
 
-static int loop(int fd, int timeout)
+static void pet(void)
 {
 	int dummy = 0;
-	int period = timeout / 2;
 
-	ioctl(fd, WDIOC_SETTIMEOUT, &timeout);
+	ioctl(wdog_fd, WDIOC_KEEPALIVE, &dummy);
+	if (!going_down && wdt.pretimeout)
+		uev_timer_set(&pre_timer, (wdt.timeout - wdt.pretimeout) * 1000, 0);
+}
+
+static int check_pid1(char *why, size_t len)
+{
+	/* Reports start with the main loop, bootstrap may take a while */
+	if (!last_report) {
+		if (now_ms() - started <= wdt.boot * 1000L)
+			return 0;
+
+		snprintf(why, len, "PID 1 bootstrap not done in %d sec", wdt.boot);
+		return 1;
+	}
+
+	if (now_ms() - last_report > 2 * report_ms) {
+		snprintf(why, len, "no health report from PID 1");
+		return 1;
+	}
+
+	if (!report.ok) {
+		strlcpy(why, report.why, len);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int check_load(char *why, size_t len)
+{
+	double avg;
+
+	if (wdt.load <= 0 || getloadavg(&avg, 1) != 1)
+		return 0;
 
-	while (running) {
-		ioctl(fd, WDIOC_KEEPALIVE, &dummy);
-		sleep(period);
+	if (avg > wdt.load) {
+		snprintf(why, len, "load average %.2f", avg);
+		return 1;
 	}
 
-	/* System is going down, prepare to reboot system on TERM */
-	if (shutdown) {
-		timeout /= 3;
-		ioctl(fd, WDIOC_SETTIMEOUT, &timeout);
+	return 0;
+}
+
+static int check_memory(char *why, size_t len)
+{
+	char line[128];
+	double avg = 0;
+	FILE *fp;
+
+	if (wdt.memory <= 0)
+		return 0;
+
+	fp = fopen("/proc/pressure/memory", "r");
+	if (!fp)
+		return 0;	/* No PSI in kernel */
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "full avg10=%lf", &avg) == 1)
+			break;
 	}
+	fclose(fp);
 
-	/* External watchdogd wants to take over ... */
-	if (handover) {
-		ioctl(fd, WDIOC_KEEPALIVE, &dummy);
-		return !write(fd, "V", 1);
+	if (avg > wdt.memory) {
+		snprintf(why, len, "memory pressure %.2f%%", avg);
+		return 1;
 	}
 
 	return 0;
 }
 
+static int check_writable(char *why, size_t len)
+{
+	char file[sizeof(wdt.writable) + 20];
+	int fd, rc = 0;
+
+	if (!wdt.writable[0])
+		return 0;
+
+	snprintf(file, sizeof(file), "%s/.finit-watchdog", wdt.writable);
+	fd = open(file, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd == -1 || write(fd, "1", 1) != 1 || fsync(fd))
+		rc = 1;
+	if (fd != -1) {
+		close(fd);
+		unlink(file);
+	}
+
+	if (rc)
+		snprintf(why, len, "%s not writable: %s", wdt.writable, strerror(errno));
+
+	return rc;
+}
+
+static int (*checks[])(char *why, size_t len) = {
+	check_pid1,
+	check_load,
+	check_memory,
+	check_writable,
+};
+
+/* Only kick the watchdog if all health checks pass */
+static void pet_cb(uev_t *w, void *arg, int events)
+{
+	char why[sizeof(failed)];
+	size_t i;
+
+	if (going_down) {
+		pet();
+		return;
+	}
+
+	for (i = 0; i < NELEMS(checks); i++) {
+		if (!checks[i](why, sizeof(why)))
+			continue;
+
+		/* Log once, not every round, the values may differ */
+		if ((int)i != failing)
+			logit(LOG_WARNING, "Health check failed, %s, not kicking watchdog.", why);
+		strlcpy(failed, why, sizeof(failed));
+		failing = i;
+		return;
+	}
+
+	if (failing != -1) {
+		logit(LOG_NOTICE, "System healthy again, kicking watchdog.");
+		failed[0] = 0;
+		failing = -1;
+	}
+
+	pet();
+}
+
+static void pre_cb(uev_t *w, void *arg, int events)
+{
+	wdog_msg_t msg = { .ok = 0 };
+
+	logit(LOG_ALERT, "Watchdog reset in %d sec, %s!", wdt.pretimeout,
+	      failed[0] ? failed : "not kicked");
+
+	/* Tell PID 1, for HOOK_WDOG_PRETIMEOUT */
+	strlcpy(msg.why, failed[0] ? failed : "not kicked", sizeof(msg.why));
+	send(wdog_sd, &msg, sizeof(msg), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+static void report_in_cb(uev_t *w, void *arg, int events)
+{
+	wdog_msg_t msg;
+	ssize_t len;
+
+	len = recv(w->fd, &msg, sizeof(msg), MSG_DONTWAIT);
+	if (len < 0 && errno == EAGAIN)
+		return;
+	if (len != sizeof(msg)) {
+		uev_io_stop(w);
+		return;
+	}
+
+	msg.why[sizeof(msg.why) - 1] = 0;
+	report = msg;
+	last_report = now_ms();
+}
+
+/* System is going down, shorter timeout and keep kicking until reboot */
+static void sigpwr_cb(uev_t *w, void *arg, int events)
+{
+	int period;
+
+	going_down = 1;
+	uev_timer_stop(&pre_timer);
+
+	wdt.timeout /= 3;
+	if (wdt.timeout < 2)
+		wdt.timeout = 2;
+	ioctl(wdog_fd, WDIOC_SETTIMEOUT, &wdt.timeout);
+
+	period = wdt.timeout * 1000 / 2;
+	uev_timer_set(&pet_timer, period, period);
+}
+
+/*
+ * Reboot pending, after SIGPWR: set lowest possible timeout and stop
+ * kicking.  Otherwise an external watchdogd wants to take over, so do
+ * a magic close to disarm the watchdog until it opens the device.
+ */
+static void sigterm_cb(uev_t *w, void *arg, int events)
+{
+	int rc = 0;
+
+	if (going_down) {
+		int timeout = 1;
+
+		ioctl(wdog_fd, WDIOC_SETTIMEOUT, &timeout);
+	} else {
+		int dummy = 0;
+
+		ioctl(wdog_fd, WDIOC_KEEPALIVE, &dummy);
+		rc = write(wdog_fd, "V", 1) != 1;
+	}
+
+	close(wdog_fd);
+	_exit(rc);
+}
+
+static int wdog_run(void)
+{
+	uev_t sigterm, sigpwr, reports;
+	uev_ctx_t loop;
+	sigset_t mask;
+	int period;
+
+	/* PID 1 ignores all signals, block before restoring default */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGPWR);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGPWR,  SIG_DFL);
+
+	if (uev_init(&loop))
+		return 1;
+
+	ioctl(wdog_fd, WDIOC_SETTIMEOUT, &wdt.timeout);
+	ioctl(wdog_fd, WDIOC_GETTIMEOUT, &wdt.timeout);
+	wdog_limits();
+	started = now_ms();
+
+	period = wdt.interval * 1000;
+	if (uev_signal_init(&loop, &sigterm, sigterm_cb, NULL, SIGTERM) ||
+	    uev_signal_init(&loop, &sigpwr,  sigpwr_cb,  NULL, SIGPWR)  ||
+	    uev_io_init(&loop, &reports, report_in_cb, NULL, wdog_sd, UEV_READ) ||
+	    uev_timer_init(&loop, &pet_timer, pet_cb, NULL, period, period))
+		return 1;
+	if (wdt.pretimeout)
+		uev_timer_init(&loop, &pre_timer, pre_cb, NULL, (wdt.timeout - wdt.pretimeout) * 1000, 0);
+
+	pet();
+
+	return uev_run(&loop, 0);
+}
+
+/**
+ * watchdog - Start built-in watchdog
+ * @progname: argv[0] of PID 1, the watchdog process is renamed
+ *
+ * The watchdog runs as a separate process, so it can keep kicking
+ * while PID 1 is busy rebooting the system.  It only kicks the device
+ * when all health checks pass: PID 1 must report in regularly, all
+ * critical services must be alive, and optionally the load, memory
+ * pressure, and a writable file system are checked.
+ *
+ * Returns:
+ * PID of watchdog process, or 0 on error.
+ */
 int watchdog(char *progname)
 {
+	int sd[2];
 	int pid;
 
+	wdog_limits();
+	report_ms = wdt.interval * 1000;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sd)) {
+		_pe("Failed creating watchdog socket");
+		return 0;
+	}
+
 	pid = fork();
 	if (pid == 0) {
-		int fd, ret;
+		close(sd[0]);
+		wdog_sd = sd[1];
 
-		fd = init(progname, WDT_DEVNODE);
-		if (fd == -1) {
-			_pe("Failed connecting to watchdog %s", WDT_DEVNODE);
+		sprintf(progname, "@finit-watchdog");
+		wdog_fd = open(wdt.dev, O_WRONLY | O_CLOEXEC);
+		if (wdog_fd == -1) {
+			_pe("Failed connecting to watchdog %s", wdt.dev);
 			_exit(1);
 		}
 
-		ret = loop(fd, WDT_TIMEOUT);
-		while (!handover) {
-			/* Waiting for SIGTERM ... */
-			sleep(1);
-
-			/* Set lowest possible timeout on SIGTERM */
-			ioctl(fd, WDIOC_SETTIMEOUT, &shutdown);
-		}
-		close(fd);
+		_exit(wdog_run());
+	}
 
-		_exit(ret);
+	close(sd[1]);
+	if (pid < 0) {
+		_pe("Failed starting watchdog");
+		close(sd[0]);
+		return 0;
 	}
 
+	wdog_sd = sd[0];
+	uev_io_init(ctx, &notify_watcher, notify_cb, NULL, wdog_sd, UEV_READ);
+	uev_timer_init(ctx, &report_timer, report_cb, NULL, 1, report_ms);
+
 	return pid;
 }
 
+/**
+ * watchdog_conf - Parse watchdog settings from finit.conf
+ * @args: Options, separated by space
+ *
+ *     watchdog [timeout:SEC] [interval:SEC] [pretimeout:SEC]
+ *              [load:AVG] [memory:PCT] [writable:DIR] [DEVICE]
+ *
+ * Returns:
+ * POSIX OK(0) on success, or non-zero errno exit status on failure.
+ */
+int watchdog_conf(char *args)
+{
+	const char *errstr = NULL;
+	char *arg, *val;
+
+	for (arg = strtok(args, " \t"); arg; arg = strtok(NULL, " \t")) {
+		val = strchr(arg, ':');
+		if (val)
+			*val++ = 0;
+
+		if (!val && arg[0] == '/')
+			strlcpy(wdt.dev, arg, sizeof(wdt.dev));
+		else if (val && !strcmp(arg, "timeout"))
+			wdt.timeout = strtonum(val, 2, 3600, &errstr);
+		else if (val && !strcmp(arg, "interval"))
+			wdt.interval = strtonum(val, 1, 3600, &errstr);
+		else if (val && !strcmp(arg, "pretimeout"))
+			wdt.pretimeout = strtonum(val, 0, 3600, &errstr);
+		else if (val && !strcmp(arg, "boot"))
+			wdt.boot = strtonum(val, 1, 3600, &errstr);
+		else if (val && !strcmp(arg, "load"))
+			wdt.load = atof(val);
+		else if (val && !strcmp(arg, "memory"))
+			wdt.memory = atof(val);
+		else if (val && !strcmp(arg, "writable"))
+			strlcpy(wdt.writable, val, sizeof(wdt.writable));
+		else
+			errstr = "unknown option";
+
+		if (errstr) {
+			_e("watchdog: %s %s", errstr, arg);
+			return errno = EINVAL;
+		}
+	}
+
+	return 0;
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
@@ -25,11 +25,14 @@
 
 #define WDT_DEVNODE "/dev/watchdog"
 #define WDT_TIMEOUT 30
+#define WDT_BOOT    300	/* Max sec before first report from PID 1 */
 
 #ifdef BUILTIN_WATCHDOG
 int     watchdog(char *progname);
+int     watchdog_conf(char *args);
 #else
 #define watchdog(progname) 0
+#define watchdog_conf(args) (errno = ENOTSUP)
 #endif /* BUILTIN_WATCHDOG */
 
 /**